@@ -127,8 +127,7 @@ function setup_env() {
 
 function get_accel_type() {
 	case ${ABI} in
-		amd64) echo amd64 ;;
-		x86) echo x86 ;;
+		amd64|x86) echo runtime ;;
 		*) echo generic ;;
 	esac
 }
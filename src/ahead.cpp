@@ -0,0 +1,381 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (decode-ahead stream decoder)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo.h"
+#include "capseo_private.h"
+
+#include <pthread.h>
+#include <string.h>
+
+/* The decode-ahead stream decoder is the asynchronous encoder's counterpart,
+ * a pipeline of three stages working on a ring of frame slots:
+ *
+ *  1. the reader thread reads the next encoded frame into any free slot
+ *  2. the decoder thread decodes read slots, in order
+ *  3. the caller takes decoded slots, in order, holding a reference to each
+ *
+ * A slot is free again once the caller released all its references. Frames
+ * held by the caller just leave fewer slots for decoding ahead, as the reader
+ * takes any free slot and numbers the frames it reads, for the later stages
+ * to follow. Decoding stays a single thread, as (delta) decoding depends on
+ * the previous frame; sliced formats still decompress on their worker pool
+ * though.
+ *
+ * The threads are started by the first frame taken, and stopped (dropping
+ * all frames not taken yet) when seeking.
+ */
+
+enum TAheadState {
+	AHEAD_FREE,
+	AHEAD_READ,
+	AHEAD_DECODED,
+	AHEAD_TAKEN
+};
+
+struct TAheadSlot {
+	capseo_frame_t frame;				//!< decoded frame (first, so frames handed out lead back to their slot)
+	TAheadState state;
+	uint64_t sequence;					//!< number of the frame read into the slot, since (re)starting
+	int refs;							//!< references held by the caller, once taken
+
+	int status;							//!< CAPSEO_SUCCESS, or the error met reading or decoding the frame
+	bool end;							//!< no frame could be read, so none follows
+
+	uint8_t *encodedFrame;				//!< the encoded frame, in buffer or the stream's mapping
+	uint32_t encodedLength;
+
+	uint8_t *buffer;					//!< read buffer, unless the stream file is mapped
+	uint32_t bufferLength;
+};
+
+struct TCapseoDecodeAhead {
+	capseo_stream_t *stream;
+
+	TAheadSlot *slots;
+	int slotCount;
+
+	uint64_t readCount;					//!< number of frames read since (re)starting
+	uint64_t decodeCount;				//!< number of frames decoded since (re)starting
+	uint64_t takeCount;					//!< number of frames taken since (re)starting
+
+	int cursor;							//!< whether to draw the cursor, as last requested by the caller
+
+	pthread_mutex_t lock;
+	pthread_cond_t slotFreed;
+	pthread_cond_t slotRead;
+	pthread_cond_t slotDecoded;
+
+	pthread_t readerThread;
+	pthread_t decoderThread;
+	bool readerRunning;
+	bool decoderRunning;
+
+	bool quit;							//!< the threads are to leave, dropping their current work
+};
+
+/*! \brief finds a free slot, or the one in the given state holding the given frame (with the lock held).
+ */
+static TAheadSlot *findSlot(TCapseoDecodeAhead *ahead, TAheadState AState, uint64_t ASequence) {
+	for (int i = 0; i < ahead->slotCount; ++i)
+		if (ahead->slots[i].state == AState && (AState == AHEAD_FREE || ahead->slots[i].sequence == ASequence))
+			return &ahead->slots[i];
+
+	return 0;
+}
+
+static void *readerMain(void *AHandle) {
+	TCapseoDecodeAhead *ahead = (TCapseoDecodeAhead *)AHandle;
+
+	pthread_mutex_lock(&ahead->lock);
+	for (;;) {
+		TAheadSlot *slot;
+
+		while (!ahead->quit && !(slot = findSlot(ahead, AHEAD_FREE, 0)))
+			pthread_cond_wait(&ahead->slotFreed, &ahead->lock);
+
+		if (ahead->quit)
+			break;
+
+		pthread_mutex_unlock(&ahead->lock);
+
+		// the slot is exclusively ours until marked as read
+		int status = readStreamFrame(ahead->stream, &slot->buffer, &slot->bufferLength,
+			&slot->encodedFrame, &slot->encodedLength);
+
+		pthread_mutex_lock(&ahead->lock);
+
+		slot->status = status;
+		slot->end = status != CAPSEO_SUCCESS;
+		slot->state = AHEAD_READ;
+		slot->sequence = ahead->readCount++;
+		pthread_cond_signal(&ahead->slotRead);
+
+		// (the stream's end or a read error is reported by the slot, and by every take after it)
+		if (slot->end)
+			break;
+	}
+	pthread_mutex_unlock(&ahead->lock);
+
+	return 0;
+}
+
+static void *decoderMain(void *AHandle) {
+	TCapseoDecodeAhead *ahead = (TCapseoDecodeAhead *)AHandle;
+	capseo_t *cs = &ahead->stream->frameHandle;
+
+	pthread_mutex_lock(&ahead->lock);
+	for (;;) {
+		TAheadSlot *slot;
+
+		while (!ahead->quit && !(slot = findSlot(ahead, AHEAD_READ, ahead->decodeCount)))
+			pthread_cond_wait(&ahead->slotRead, &ahead->lock);
+
+		if (ahead->quit)
+			break;
+
+		const int cursor = ahead->cursor;
+
+		pthread_mutex_unlock(&ahead->lock);
+
+		if (!slot->end)
+			slot->status = CapseoDecodeFrame(cs, slot->encodedFrame, slot->encodedLength, cursor, &slot->frame);
+
+		pthread_mutex_lock(&ahead->lock);
+
+		slot->state = AHEAD_DECODED;
+		++ahead->decodeCount;
+		pthread_cond_signal(&ahead->slotDecoded);
+	}
+	pthread_mutex_unlock(&ahead->lock);
+
+	return 0;
+}
+
+/*! \brief creates the decode-ahead frame ring for the given decoding stream.
+ *  \param stream the decoding stream
+ *  \param AFrames number of frames to decode ahead (including the ones held by the caller)
+ *  \retval CAPSEO_SUCCESS success
+ *
+ *  The threads are not started before the first frame is taken.
+ */
+int createDecodeAhead(capseo_stream_t *stream, int AFrames) {
+	const capseo_info_t& info = stream->frameHandle.info;
+	const int decodedBufferLength = info.width * info.height * 4;
+
+	TCapseoDecodeAhead *ahead = new TCapseoDecodeAhead;
+	bzero(ahead, sizeof(*ahead));
+
+	ahead->stream = stream;
+	ahead->slotCount = AFrames;
+	ahead->slots = new TAheadSlot[AFrames];
+
+	for (int i = 0; i < AFrames; ++i) {
+		TAheadSlot *slot = &ahead->slots[i];
+		bzero(slot, sizeof(*slot));
+
+		slot->state = AHEAD_FREE;
+		slot->frame.buffer = new uint8_t[decodedBufferLength];
+		bzero(slot->frame.buffer, decodedBufferLength);
+	}
+
+	pthread_mutex_init(&ahead->lock, 0);
+	pthread_cond_init(&ahead->slotFreed, 0);
+	pthread_cond_init(&ahead->slotRead, 0);
+	pthread_cond_init(&ahead->slotDecoded, 0);
+
+	stream->ahead = ahead;
+
+	return CAPSEO_SUCCESS;
+}
+
+/*! \brief stops the decode-ahead threads and drops all frames not taken yet.
+ *
+ *  Frames held by the caller stay valid. The stream is positioned after the last frame read,
+ *  so it is to be repositioned (i.e. sought) before taking frames again.
+ */
+void stopDecodeAhead(capseo_stream_t *stream) {
+	TCapseoDecodeAhead *ahead = stream->ahead;
+
+	pthread_mutex_lock(&ahead->lock);
+	ahead->quit = true;
+	pthread_cond_broadcast(&ahead->slotFreed);
+	pthread_cond_broadcast(&ahead->slotRead);
+	pthread_mutex_unlock(&ahead->lock);
+
+	if (ahead->readerRunning)
+		pthread_join(ahead->readerThread, 0);
+
+	if (ahead->decoderRunning)
+		pthread_join(ahead->decoderThread, 0);
+
+	ahead->readerRunning = false;
+	ahead->decoderRunning = false;
+	ahead->quit = false;
+
+	for (int i = 0; i < ahead->slotCount; ++i)
+		if (ahead->slots[i].state != AHEAD_TAKEN)
+			ahead->slots[i].state = AHEAD_FREE;
+
+	ahead->readCount = ahead->decodeCount = ahead->takeCount = 0;
+}
+
+/*! \brief stops the decode-ahead threads and destructs the frame ring, including the frames held by the caller.
+ */
+void destroyDecodeAhead(capseo_stream_t *stream) {
+	TCapseoDecodeAhead *ahead = stream->ahead;
+
+	stopDecodeAhead(stream);
+
+	pthread_cond_destroy(&ahead->slotDecoded);
+	pthread_cond_destroy(&ahead->slotRead);
+	pthread_cond_destroy(&ahead->slotFreed);
+	pthread_mutex_destroy(&ahead->lock);
+
+	for (int i = 0; i < ahead->slotCount; ++i) {
+		delete[] ahead->slots[i].frame.buffer;
+		delete[] ahead->slots[i].buffer;
+	}
+	delete[] ahead->slots;
+
+	delete ahead;
+	stream->ahead = 0;
+}
+
+/*! \brief starts the decode-ahead threads, if not running yet (with the lock held).
+ */
+static int startDecodeAhead(TCapseoDecodeAhead *ahead) {
+	if (ahead->readerRunning)
+		return CAPSEO_SUCCESS;
+
+	ahead->decoderRunning = pthread_create(&ahead->decoderThread, 0, &decoderMain, ahead) == 0;
+	ahead->readerRunning = ahead->decoderRunning
+		&& pthread_create(&ahead->readerThread, 0, &readerMain, ahead) == 0;
+
+	if (ahead->readerRunning)
+		return CAPSEO_SUCCESS;
+
+	if (ahead->decoderRunning) {
+		ahead->quit = true;
+		pthread_cond_broadcast(&ahead->slotRead);
+		pthread_mutex_unlock(&ahead->lock);
+
+		pthread_join(ahead->decoderThread, 0);
+
+		pthread_mutex_lock(&ahead->lock);
+		ahead->decoderRunning = false;
+		ahead->quit = false;
+	}
+
+	return CAPSEO_E_SYSTEM;
+}
+
+/*! \brief takes the next decoded frame off the ring, waiting for it if needed.
+ *  \retval CAPSEO_SUCCESS success, the caller holds a reference to the frame
+ *  \retval CAPSEO_STREAM_END there are no more frames
+ *  \retval CAPSEO_E_INVALID_ARGUMENT the caller still holds all frames of the ring
+ *  \retval CAPSEO_E_SYSTEM could not create the threads, or read error
+ *  \return or any error returned by CapseoDecodeFrame()
+ */
+int takeAheadFrame(capseo_stream_t *stream, capseo_frame_t **frame, int cursor) {
+	TCapseoDecodeAhead *ahead = stream->ahead;
+
+	pthread_mutex_lock(&ahead->lock);
+
+	ahead->cursor = cursor;
+
+	// (no frame would ever be read)
+	int taken = 0;
+	for (int i = 0; i < ahead->slotCount; ++i)
+		taken += ahead->slots[i].state == AHEAD_TAKEN;
+
+	if (taken == ahead->slotCount) {
+		pthread_mutex_unlock(&ahead->lock);
+		return CAPSEO_E_INVALID_ARGUMENT;
+	}
+
+	if (int error = startDecodeAhead(ahead)) {
+		pthread_mutex_unlock(&ahead->lock);
+		return error;
+	}
+
+	TAheadSlot *slot;
+	while (!(slot = findSlot(ahead, AHEAD_DECODED, ahead->takeCount)))
+		pthread_cond_wait(&ahead->slotDecoded, &ahead->lock);
+
+	const int status = slot->status;
+
+	if (slot->end) {
+		pthread_mutex_unlock(&ahead->lock);
+		return status;
+	}
+
+	++ahead->takeCount;
+
+	if (status) {
+		slot->state = AHEAD_FREE;
+		pthread_cond_signal(&ahead->slotFreed);
+	} else {
+		slot->state = AHEAD_TAKEN;
+		slot->refs = 1;
+		*frame = &slot->frame;
+	}
+
+	pthread_mutex_unlock(&ahead->lock);
+
+	return status;
+}
+
+/*! \brief maps a frame handed out back to its slot, if it is held by the caller.
+ */
+static TAheadSlot *takenSlotOf(TCapseoDecodeAhead *ahead, capseo_frame_t *frame) {
+	TAheadSlot *slot = (TAheadSlot *)frame;
+
+	if (slot < ahead->slots || slot >= ahead->slots + ahead->slotCount || slot->state != AHEAD_TAKEN)
+		return 0;
+
+	return slot;
+}
+
+/*! \brief adds a reference to a frame held by the caller.
+ */
+int retainAheadFrame(capseo_stream_t *stream, capseo_frame_t *frame) {
+	TCapseoDecodeAhead *ahead = stream->ahead;
+
+	pthread_mutex_lock(&ahead->lock);
+
+	TAheadSlot *slot = takenSlotOf(ahead, frame);
+	if (slot)
+		++slot->refs;
+
+	pthread_mutex_unlock(&ahead->lock);
+
+	return slot ? CAPSEO_SUCCESS : CAPSEO_E_INVALID_ARGUMENT;
+}
+
+/*! \brief drops a reference to a frame held by the caller, handing it back to the reader once unreferenced.
+ */
+void releaseAheadFrame(capseo_stream_t *stream, capseo_frame_t *frame) {
+	TCapseoDecodeAhead *ahead = stream->ahead;
+
+	pthread_mutex_lock(&ahead->lock);
+
+	TAheadSlot *slot = takenSlotOf(ahead, frame);
+	if (slot && --slot->refs == 0) {
+		slot->state = AHEAD_FREE;
+		pthread_cond_signal(&ahead->slotFreed);
+	}
+
+	pthread_mutex_unlock(&ahead->lock);
+}
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,33 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (scalar row kernels of the non-dispatching accel libraries)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "filter.h"
+#include "blend.h"
+
+static const TFilterKernels genericFilterKernels = {
+	&filterRow_generic, &unfilterRow_generic
+};
+
+const TFilterKernels *filterKernels() {
+	return &genericFilterKernels;
+}
+
+static const TBlendKernels genericBlendKernels = {
+	&blendRow_generic
+};
+
+const TBlendKernels *blendKernels() {
+	return &genericBlendKernels;
+}
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,160 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (downscales and converts BGRA frames to YUV420 in a single pass)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This code is based on seom:
+//      (http://neopsis.com/projects/seom/)
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo_private.h"
+
+
+#define ri 2
+#define gi 1
+#define bi 0
+
+#define SCALE 8
+#define F(x) ((uint16_t) ((x) * (1L << SCALE) + 0.5))
+
+static const uint16_t m[3][3] = {
+	{ F(0.098), F(0.504), F(0.257) },
+	{ F(0.439), F(0.291), F(0.148) },
+	{ F(0.071), F(0.368), F(0.439) }
+};
+
+// computes the y component of the BGRA pixel at p
+#define SY(p) \
+	(uint8_t) (((m[0][ri] * (p)[ri] + m[0][gi] * (p)[gi] + m[0][bi] * (p)[bi]) >> SCALE) + 16)
+
+static void convertRows(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		const uint8_t *s0, const uint8_t *s1, uint32_t width) {
+	for (uint32_t x = 0; x < width; x += 2, s0 += 8, s1 += 8) {
+		*y0++ = SY(s0);
+		*y0++ = SY(s0 + 4);
+		*y1++ = SY(s1);
+		*y1++ = SY(s1 + 4);
+
+		// sum up all blue, green and red components of the 2x2 pixels
+		const int r[3] = {
+			s0[0] + s0[4] + s1[0] + s1[4], // blue
+			s0[1] + s0[5] + s1[1] + s1[5], // green
+			s0[2] + s0[6] + s1[2] + s1[6], // red
+		};
+
+		*u++ = (uint8_t) ((-m[1][ri] * r[ri] - m[1][gi] * r[gi] + m[1][bi] * r[bi]) >> (SCALE + 2)) + 128;
+		*v++ = (uint8_t) ((m[2][ri] * r[ri] - m[2][gi] * r[gi] - m[2][bi] * r[bi]) >> (SCALE + 2)) + 128;
+	}
+}
+
+static void scaleRow(uint8_t *dst, const uint8_t *s0, const uint8_t *s1, uint32_t width) {
+	for (uint32_t x = 0; x < width; x += 2, s0 += 8, s1 += 8, dst += 4) {
+		dst[0] = (s0[0] + s0[4] + s1[0] + s1[4]) / 4; // B
+		dst[1] = (s0[1] + s0[5] + s1[1] + s1[5]) / 4; // G
+		dst[2] = (s0[2] + s0[6] + s1[2] + s1[6]) / 4; // R
+	}
+}
+
+/*! \brief converts the BGRA rows \p s0 and \p s1 into rows \p y and (y + 1) of the YUV 4:2:0 frame of width \p w.
+ *
+ *  Pixels are converted in pairs, so an odd last column is converted along with the
+ *  column before it (overlapping the previous pair).
+ */
+static void convertPair(uint8_t *yuv[3], uint32_t w, uint32_t y, const uint8_t *s0, const uint8_t *s1) {
+	uint8_t *y0 = yuv[0] + y * w;
+	uint8_t *u = yuv[1] + y/2 * (w/2);
+	uint8_t *v = yuv[2] + y/2 * (w/2);
+	const uint32_t even = w & ~1;
+
+	convertRows(y0, y0 + w, u, v, s0, s1, even);
+
+	if (w & 1) {
+		const uint32_t x = w - 2;
+		convertRows(y0 + x, y0 + w + x, u + x/2, v + x/2, s0 + x * 4, s1 + x * 4, 2);
+	}
+}
+
+struct TPyramid {
+	const uint8_t *source;				//!< top row of the source frame
+	int32_t stride;						//!< distance between two source rows, in bytes
+	uint32_t width[MAX_SCALE_LEVELS + 1];	//!< row width (in pixels) per level
+	uint32_t height;					//!< source height
+	uint8_t *rows[MAX_SCALE_LEVELS + 1][2];	//!< two rows of scratch per level (except level 0)
+};
+
+/*! \brief computes row \p AY of the given scale level.
+ *  \param ASlot which of the level's two scratch rows to use
+ *  \return the row
+ *
+ *  Each level is computed from the two rows of the level below, exactly as
+ *  repeated calls to scaleBGRA() would do, so the results are identical.
+ */
+static const uint8_t *scaledRow(TPyramid *p, int ALevel, uint32_t AY, int ASlot) {
+	if (ALevel == 0)
+		return p->source + long(AY < p->height ? AY : p->height - 1) * p->stride;
+
+	const uint8_t *s0 = scaledRow(p, ALevel - 1, AY * 2, 0);
+	const uint8_t *s1 = scaledRow(p, ALevel - 1, AY * 2 + 1, 1);
+
+	uint8_t *dst = p->rows[ALevel][ASlot];
+	scaleRow(dst, s0, s1, p->width[ALevel - 1]);
+
+	return dst;
+}
+
+/*! \brief downscales the given BGRA frame by 2^\p scale (if non-zero) and converts it to YUV 4:2:0.
+ *
+ *  \p yuv the Y, U and V planes of the (downscaled) destination frame.
+ *  \p src the top row of the BGRA source frame, which is left untouched.
+ *  \p stride distance between two source rows in bytes, negative for bottom-up frames.
+ *  \p w source frame width.
+ *  \p h source frame height.
+ *  \p scale number of times to halve the frame dimensions.
+ *  \p scratch scratch space of scaleScratchLength() bytes (kept by the caller, e.g. per handle).
+ *
+ *  The source is read only once, while the intermediate scale levels are kept
+ *  in a few rows of scratch space.
+ */
+void convertBGRAtoYUV420Scaled(uint8_t *yuv[3], const uint8_t *src, int32_t stride, uint32_t w, uint32_t h, int scale, uint8_t *scratch) {
+	if (scale > MAX_SCALE_LEVELS)
+		scale = MAX_SCALE_LEVELS;
+
+	TPyramid p;
+	p.source = src;
+	p.stride = stride;
+	p.height = h;
+	p.width[0] = w;
+
+	for (int i = 1; i <= scale; ++i)
+		p.width[i] = p.width[i - 1] / 2;
+
+	// (see scaleScratchLength())
+	for (int i = 1, offset = 0; i <= scale; ++i) {
+		for (int j = 0; j < 2; ++j, offset += (p.width[i] + 2) * 4)
+			p.rows[i][j] = scratch + offset;
+	}
+
+	const uint32_t sw = p.width[scale];
+	const uint32_t sh = h >> scale;
+
+	// (frames narrower or lower than a pixel pair have no 4:2:0 layout)
+	if (sw < 2 || sh < 2)
+		return;
+
+	for (uint32_t y = 0; y < sh; y += 2) {
+		const uint32_t row = pairRow(y, sh);
+		const uint8_t *s0 = scaledRow(&p, scale, row, 0);
+		const uint8_t *s1 = scaledRow(&p, scale, row + 1, 1);
+
+		convertPair(yuv, sw, row, s0, s1);
+	}
+}
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,85 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (converts YUV420 frames to 32 bit RGB pixels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo_private.h"
+
+static inline uint8_t clip(int x) {
+	return x < 0 ? 0 : x > 255 ? 255 : uint8_t(x);
+}
+
+// stores the pixel of luma l and the chroma terms cr, cg, cb (ITU-R BT.601, 8 bit fixed point)
+static inline void putPixel(uint8_t *dst, int l, int cr, int cg, int cb, const TPixelLayout *layout) {
+	const int c = 298 * (l - 16);
+
+	dst[layout->r] = clip((c + cr) >> 8);
+	dst[layout->g] = clip((c + cg) >> 8);
+	dst[layout->b] = clip((c + cb) >> 8);
+	dst[layout->a] = 0xFF;
+}
+
+static void convertRows(uint8_t *d0, uint8_t *d1, const uint8_t *y0, const uint8_t *y1,
+		const uint8_t *u, const uint8_t *v, uint32_t width, const TPixelLayout *layout) {
+	for (uint32_t x = 0; x < width; x += 2, d0 += 8, d1 += 8, y0 += 2, y1 += 2) {
+		const int d = *u++ - 128;
+		const int e = *v++ - 128;
+
+		const int cr = 409 * e + 128;
+		const int cg = 128 - 100 * d - 208 * e;
+		const int cb = 516 * d + 128;
+
+		putPixel(d0, y0[0], cr, cg, cb, layout);
+		putPixel(d0 + 4, y0[1], cr, cg, cb, layout);
+		putPixel(d1, y1[0], cr, cg, cb, layout);
+		putPixel(d1 + 4, y1[1], cr, cg, cb, layout);
+	}
+}
+
+/*! \brief converts rows \p y and (y + 1) of the YUV 4:2:0 frame of width \p w into RGB pixels.
+ *
+ *  Pixels are converted in pairs, so an odd last column is converted along with the
+ *  column before it (overlapping the previous pair).
+ */
+static void convertPair(uint8_t *rgb, uint8_t *yuv[3], uint32_t w, uint32_t y, const TPixelLayout *layout) {
+	uint8_t *d0 = rgb + y * (w * 4);
+	const uint8_t *y0 = yuv[0] + y * w;
+	const uint8_t *u = yuv[1] + y/2 * (w/2);
+	const uint8_t *v = yuv[2] + y/2 * (w/2);
+	const uint32_t even = w & ~1;
+
+	convertRows(d0, d0 + w * 4, y0, y0 + w, u, v, even, layout);
+
+	if (w & 1) {
+		const uint32_t x = w - 2;
+		convertRows(d0 + x * 4, d0 + (w + x) * 4, y0 + x, y0 + w + x, u + x/2, v + x/2, 2, layout);
+	}
+}
+
+/*! \brief converts the given YUV 4:2:0 frame to 32 bit RGB pixels.
+ *
+ *  \p rgb the destination frame, of (w * h) tightly packed pixels.
+ *  \p yuv the Y, U and V planes of the source frame.
+ *  \p w frame width.
+ *  \p h frame height.
+ *  \p layout byte offsets of the colour components within a destination pixel.
+ */
+void convertYUV420toRGB(uint8_t *rgb, uint8_t *yuv[3], uint32_t w, uint32_t h, const TPixelLayout *layout) {
+	// (frames narrower or lower than a pixel pair have no 4:2:0 layout)
+	if (w < 2 || h < 2)
+		return;
+
+	// (an odd last row is converted along with the row before it, see pairRow())
+	for (uint32_t y = 0; y < h; y += 2)
+		convertPair(rgb, yuv, w, pairRow(y, h), layout);
+}
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,236 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (AVX2 row kernels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "kernels.h"
+
+#include <string.h>
+
+#if defined(CAPSEO_KERNELS_X86)
+
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+// restores linear element order after in-lane packing
+#define LINEAR(x) _mm256_permute4x64_epi64((x), _MM_SHUFFLE(3, 1, 2, 0))
+
+/*! \brief splits 16 BGRA pixels into their 16 bit blue, green and red components.
+ */
+static inline void unpackBGR(const uint8_t *src, __m256i& b, __m256i& g, __m256i& r) {
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	const __m256i p0 = _mm256_loadu_si256((const __m256i *)src);
+	const __m256i p1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+
+	b = LINEAR(_mm256_packs_epi32(_mm256_and_si256(p0, mask), _mm256_and_si256(p1, mask)));
+	g = LINEAR(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), mask),
+		_mm256_and_si256(_mm256_srli_epi32(p1, 8), mask)));
+	r = LINEAR(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask),
+		_mm256_and_si256(_mm256_srli_epi32(p1, 16), mask)));
+}
+
+/*! \brief computes 16 luma values out of the 16 bit colour components.
+ */
+static inline __m256i lumaOf(__m256i b, __m256i g, __m256i r) {
+	__m256i y = _mm256_mullo_epi16(b, _mm256_set1_epi16(25));
+	y = _mm256_add_epi16(y, _mm256_mullo_epi16(g, _mm256_set1_epi16(129)));
+	y = _mm256_add_epi16(y, _mm256_mullo_epi16(r, _mm256_set1_epi16(66)));
+
+	return _mm256_add_epi16(_mm256_srli_epi16(y, 8), _mm256_set1_epi16(16));
+}
+
+/*! \brief computes 8 chroma values (as 32 bit integers) out of 8 2x2 colour component sums.
+ */
+static inline __m256i chromaOf(__m256i bg, __m256i r0, __m256i cbg, __m256i cr) {
+	__m256i c = _mm256_add_epi32(_mm256_madd_epi16(bg, cbg), _mm256_madd_epi16(r0, cr));
+	return _mm256_add_epi32(_mm256_srai_epi32(c, 10), _mm256_set1_epi32(128));
+}
+
+/*! \brief broadcasts the 16 bit pair (ALow, AHigh) into each 32 bit element.
+ */
+static inline __m256i pairOf(int16_t ALow, int16_t AHigh) {
+	return _mm256_set1_epi32(int(uint16_t(ALow) | (uint32_t(uint16_t(AHigh)) << 16)));
+}
+
+void convertRowsBGRAtoYUV420_avx2(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		const uint8_t *s0, const uint8_t *s1, uint32_t width) {
+	const __m256i ones = _mm256_set1_epi16(1);
+	const __m256i zero = _mm256_setzero_si256();
+
+	// (blue, green) and (red, 0) coefficients of u and v
+	const __m256i ubg = pairOf(112, -74);
+	const __m256i ur = pairOf(-38, 0);
+	const __m256i vbg = pairOf(-18, -94);
+	const __m256i vr = pairOf(112, 0);
+
+	uint32_t x = 0;
+	for (; x + 16 <= width; x += 16, s0 += 64, s1 += 64, y0 += 16, y1 += 16, u += 8, v += 8) {
+		__m256i b0, g0, r0, b1, g1, r1;
+		unpackBGR(s0, b0, g0, r0);
+		unpackBGR(s1, b1, g1, r1);
+
+		const __m256i y = LINEAR(_mm256_packus_epi16(lumaOf(b0, g0, r0), lumaOf(b1, g1, r1)));
+		_mm_storeu_si128((__m128i *)y0, _mm256_castsi256_si128(y));
+		_mm_storeu_si128((__m128i *)y1, _mm256_extracti128_si256(y, 1));
+
+		// 2x2 sums, as 32 bit integers
+		const __m256i bs = _mm256_madd_epi16(_mm256_add_epi16(b0, b1), ones);
+		const __m256i gs = _mm256_madd_epi16(_mm256_add_epi16(g0, g1), ones);
+		const __m256i rs = _mm256_madd_epi16(_mm256_add_epi16(r0, r1), ones);
+
+		const __m256i bg = _mm256_or_si256(bs, _mm256_slli_epi32(gs, 16));
+
+		const __m256i uc = chromaOf(bg, rs, ubg, ur);
+		const __m256i vc = chromaOf(bg, rs, vbg, vr);
+
+		// u in the lower lane, v in the upper one
+		const __m256i uv = _mm256_packus_epi16(LINEAR(_mm256_packs_epi32(uc, vc)), zero);
+		_mm_storel_epi64((__m128i *)u, _mm256_castsi256_si128(uv));
+		_mm_storel_epi64((__m128i *)v, _mm256_extracti128_si256(uv, 1));
+	}
+
+	if (x < width)
+		convertRowsBGRAtoYUV420_sse2(y0, y1, u, v, s0, s1, width - x);
+}
+
+/*! \brief sums up the even and odd pixels of the 16 BGRA pixels at src, per component.
+ */
+static inline void sumPairs(const uint8_t *src, __m256i& lo, __m256i& hi) {
+	const __m256 p0 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)src));
+	const __m256 p1 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(src + 32)));
+
+	const __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0)));
+	const __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1)));
+	const __m256i zero = _mm256_setzero_si256();
+
+	lo = _mm256_add_epi16(_mm256_unpacklo_epi8(even, zero), _mm256_unpacklo_epi8(odd, zero));
+	hi = _mm256_add_epi16(_mm256_unpackhi_epi8(even, zero), _mm256_unpackhi_epi8(odd, zero));
+}
+
+void scaleRowBGRA_avx2(uint8_t *dst, const uint8_t *s0, const uint8_t *s1, uint32_t width) {
+	const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+
+	uint32_t x = 0;
+	for (; x + 16 <= width; x += 16, s0 += 64, s1 += 64, dst += 32) {
+		__m256i lo0, hi0, lo1, hi1;
+		sumPairs(s0, lo0, hi0);
+		sumPairs(s1, lo1, hi1);
+
+		const __m256i lo = _mm256_srli_epi16(_mm256_add_epi16(lo0, lo1), 2);
+		const __m256i hi = _mm256_srli_epi16(_mm256_add_epi16(hi0, hi1), 2);
+
+		// keep the destination's alpha components
+		const __m256i scaled = _mm256_andnot_si256(alpha, LINEAR(_mm256_packus_epi16(lo, hi)));
+		const __m256i old = _mm256_and_si256(alpha, _mm256_loadu_si256((const __m256i *)dst));
+
+		_mm256_storeu_si256((__m256i *)dst, _mm256_or_si256(scaled, old));
+	}
+
+	if (x < width)
+		scaleRowBGRA_sse2(dst, s0, s1, width - x);
+}
+
+/*! \brief loads 4 chroma samples as 32 bit integers, each spread over the 2 pixels sharing it.
+ */
+static inline __m256i chromaAt(const uint8_t *src) {
+	int32_t c;
+	memcpy(&c, src, sizeof(c));
+
+	const __m256i spread = _mm256_permutevar8x32_epi32(_mm256_cvtepu8_epi32(_mm_cvtsi32_si128(c)),
+		_mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+
+	return _mm256_sub_epi32(spread, _mm256_set1_epi32(128));
+}
+
+/*! \brief computes the luma terms (as 32 bit integers) of the 8 pixels at src.
+ */
+static inline __m256i lumaTermOf(const uint8_t *src) {
+	const __m256i y = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)src));
+	return _mm256_mullo_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(16)), _mm256_set1_epi32(298));
+}
+
+/*! \brief computes a colour component of 32 pixels out of their luma and chroma terms, clipped to 8 bits.
+ */
+static inline __m256i componentOf(const __m256i l[4], const __m256i c[4]) {
+	const __m256i lo = _mm256_packs_epi32(
+		_mm256_srai_epi32(_mm256_add_epi32(l[0], c[0]), 8),
+		_mm256_srai_epi32(_mm256_add_epi32(l[1], c[1]), 8));
+	const __m256i hi = _mm256_packs_epi32(
+		_mm256_srai_epi32(_mm256_add_epi32(l[2], c[2]), 8),
+		_mm256_srai_epi32(_mm256_add_epi32(l[3], c[3]), 8));
+
+	// restore linear pixel order after packing twice in-lane
+	return _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+/*! \brief interleaves the colour components of 32 pixels as given by the layout and stores them.
+ */
+static inline void storePixels(uint8_t *dst, __m256i r, __m256i g, __m256i b, const TPixelLayout *layout) {
+	__m256i p[4];
+	p[layout->r] = r;
+	p[layout->g] = g;
+	p[layout->b] = b;
+	p[layout->a] = _mm256_set1_epi8(-1);
+
+	// pixels (0..7, 16..23) and (8..15, 24..31), as component pairs
+	const __m256i lo01 = _mm256_unpacklo_epi8(p[0], p[1]);
+	const __m256i hi01 = _mm256_unpackhi_epi8(p[0], p[1]);
+	const __m256i lo23 = _mm256_unpacklo_epi8(p[2], p[3]);
+	const __m256i hi23 = _mm256_unpackhi_epi8(p[2], p[3]);
+
+	// pixels (0..3, 16..19), (4..7, 20..23), (8..11, 24..27) and (12..15, 28..31)
+	const __m256i q0 = _mm256_unpacklo_epi16(lo01, lo23);
+	const __m256i q1 = _mm256_unpackhi_epi16(lo01, lo23);
+	const __m256i q2 = _mm256_unpacklo_epi16(hi01, hi23);
+	const __m256i q3 = _mm256_unpackhi_epi16(hi01, hi23);
+
+	_mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(q0, q1, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(q2, q3, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 64), _mm256_permute2x128_si256(q0, q1, 0x31));
+	_mm256_storeu_si256((__m256i *)(dst + 96), _mm256_permute2x128_si256(q2, q3, 0x31));
+}
+
+void convertRowsYUV420toRGB_avx2(uint8_t *d0, uint8_t *d1, const uint8_t *y0, const uint8_t *y1,
+		const uint8_t *u, const uint8_t *v, uint32_t width, const TPixelLayout *layout) {
+	const __m256i half = _mm256_set1_epi32(128);
+
+	uint32_t x = 0;
+	for (; x + 32 <= width; x += 32, d0 += 128, d1 += 128, y0 += 32, y1 += 32, u += 16, v += 16) {
+		__m256i r[4], g[4], b[4], l[4];
+
+		for (int i = 0; i < 4; ++i) {
+			const __m256i d = chromaAt(u + i * 4);
+			const __m256i e = chromaAt(v + i * 4);
+
+			r[i] = _mm256_add_epi32(_mm256_mullo_epi32(e, _mm256_set1_epi32(409)), half);
+			g[i] = _mm256_sub_epi32(half, _mm256_add_epi32(
+				_mm256_mullo_epi32(d, _mm256_set1_epi32(100)), _mm256_mullo_epi32(e, _mm256_set1_epi32(208))));
+			b[i] = _mm256_add_epi32(_mm256_mullo_epi32(d, _mm256_set1_epi32(516)), half);
+		}
+
+		for (int i = 0; i < 4; ++i)
+			l[i] = lumaTermOf(y0 + i * 8);
+		storePixels(d0, componentOf(l, r), componentOf(l, g), componentOf(l, b), layout);
+
+		for (int i = 0; i < 4; ++i)
+			l[i] = lumaTermOf(y1 + i * 8);
+		storePixels(d1, componentOf(l, r), componentOf(l, g), componentOf(l, b), layout);
+	}
+
+	if (x < width)
+		convertRowsYUV420toRGB_sse2(d0, d1, y0, y1, u, v, width - x, layout);
+}
+
+#undef LINEAR
+
+#endif
+
+// vim:ai:noet:ts=4:nowrap
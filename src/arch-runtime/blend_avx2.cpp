@@ -0,0 +1,50 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (AVX2 alpha blending kernels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "kernels.h"
+
+#if defined(CAPSEO_KERNELS_X86)
+
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+/*! \brief computes round(\p x * \p t / 255) of 16 (16 bit) bytes.
+ */
+static inline __m256i fade16(__m256i x, __m256i t) {
+	const __m256i p = _mm256_add_epi16(_mm256_mullo_epi16(x, t), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(p, _mm256_srli_epi16(p, 8)), 8);
+}
+
+void blendRow_avx2(uint8_t *dst, const uint8_t *premultiplied, const uint8_t *transparency, uint32_t width) {
+	const __m256i zero = _mm256_setzero_si256();
+
+	// (unpacking and packing within lanes keeps the byte order)
+	uint32_t x = 0;
+	for (; x + 32 <= width; x += 32) {
+		const __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x));
+		const __m256i p = _mm256_loadu_si256((const __m256i *)(premultiplied + x));
+		const __m256i t = _mm256_loadu_si256((const __m256i *)(transparency + x));
+
+		const __m256i lo = fade16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(t, zero));
+		const __m256i hi = fade16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(t, zero));
+
+		_mm256_storeu_si256((__m256i *)(dst + x), _mm256_add_epi8(p, _mm256_packus_epi16(lo, hi)));
+	}
+
+	// (cursors are mostly narrower than 32 pixels)
+	blendRow_sse2(dst + x, premultiplied + x, transparency + x, width - x);
+}
+
+#endif
+
+// vim:ai:noet:ts=4:nowrap
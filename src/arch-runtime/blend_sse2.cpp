@@ -0,0 +1,48 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (SSE2 alpha blending kernels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "kernels.h"
+
+#if defined(CAPSEO_KERNELS_X86)
+
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+
+/*! \brief computes round(\p x * \p t / 255) of 8 (16 bit) bytes.
+ */
+static inline __m128i fade8(__m128i x, __m128i t) {
+	const __m128i p = _mm_add_epi16(_mm_mullo_epi16(x, t), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(p, _mm_srli_epi16(p, 8)), 8);
+}
+
+void blendRow_sse2(uint8_t *dst, const uint8_t *premultiplied, const uint8_t *transparency, uint32_t width) {
+	const __m128i zero = _mm_setzero_si128();
+
+	uint32_t x = 0;
+	for (; x + 16 <= width; x += 16) {
+		const __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+		const __m128i p = _mm_loadu_si128((const __m128i *)(premultiplied + x));
+		const __m128i t = _mm_loadu_si128((const __m128i *)(transparency + x));
+
+		const __m128i lo = fade8(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(t, zero));
+		const __m128i hi = fade8(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(t, zero));
+
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_add_epi8(p, _mm_packus_epi16(lo, hi)));
+	}
+
+	blendRow_generic(dst + x, premultiplied + x, transparency + x, width - x);
+}
+
+#endif
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,223 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (runtime CPU dispatch of the row kernels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "kernels.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const TKernels genericKernels = {
+	"generic", &convertRowsBGRAtoYUV420_generic, &scaleRowBGRA_generic,
+	&convertRowsYUV420toRGB_generic,
+	{ &filterRow_generic, &unfilterRow_generic },
+	{ &blendRow_generic }
+};
+
+#if defined(CAPSEO_KERNELS_X86)
+static const TKernels sse2Kernels = {
+	"sse2", &convertRowsBGRAtoYUV420_sse2, &scaleRowBGRA_sse2,
+	&convertRowsYUV420toRGB_sse2,
+	{ &filterRow_sse2, &unfilterRow_sse2 },
+	{ &blendRow_sse2 }
+};
+
+static const TKernels avx2Kernels = {
+	"avx2", &convertRowsBGRAtoYUV420_avx2, &scaleRowBGRA_avx2,
+	&convertRowsYUV420toRGB_avx2,
+	{ &filterRow_avx2, &unfilterRow_avx2 },
+	{ &blendRow_avx2 }
+};
+#endif
+
+static const TKernels *selectedKernels = &genericKernels;
+static pthread_once_t selectOnce = PTHREAD_ONCE_INIT;
+
+/*! \brief picks the best kernels the running CPU supports.
+ *
+ *  The environment variable CAPSEO_ACCEL (generic, sse2, avx2) may be used
+ *  to restrict the choice, e.g. for benchmarking. Kernels not supported by
+ *  the CPU are never chosen.
+ */
+static void selectKernels() {
+	const char *accel = getenv("CAPSEO_ACCEL");
+
+#if defined(CAPSEO_KERNELS_X86)
+	__builtin_cpu_init();
+
+	const bool any = !accel || !*accel;
+
+	if ((any || !strcmp(accel, "avx2")) && __builtin_cpu_supports("avx2"))
+		selectedKernels = &avx2Kernels;
+	else if ((any || !strcmp(accel, "avx2") || !strcmp(accel, "sse2")) && __builtin_cpu_supports("sse2"))
+		selectedKernels = &sse2Kernels;
+#else
+	(void) accel;
+#endif
+}
+
+/*! \brief retrieves the row kernels to use on this CPU.
+ */
+const TKernels *kernels() {
+	pthread_once(&selectOnce, &selectKernels);
+	return selectedKernels;
+}
+
+const TFilterKernels *filterKernels() {
+	return &kernels()->filter;
+}
+
+const TBlendKernels *blendKernels() {
+	return &kernels()->blend;
+}
+
+/*! \brief converts the BGRA rows \p s0 and \p s1 into rows \p y and (y + 1) of the YUV 4:2:0 frame of width \p w.
+ *
+ *  The kernels convert pixel pairs, so an odd last column is converted along with the
+ *  column before it (overlapping the previous pair).
+ */
+static void convertPairBGRAtoYUV420(TConvertRowsBGRAtoYUV420 convertRows, uint8_t *yuv[3], uint32_t w, uint32_t y,
+		const uint8_t *s0, const uint8_t *s1) {
+	uint8_t *y0 = yuv[0] + y * w;
+	uint8_t *u = yuv[1] + y/2 * (w/2);
+	uint8_t *v = yuv[2] + y/2 * (w/2);
+	const uint32_t even = w & ~1;
+
+	convertRows(y0, y0 + w, u, v, s0, s1, even);
+
+	if (w & 1) {
+		const uint32_t x = w - 2;
+		convertRows(y0 + x, y0 + w + x, u + x/2, v + x/2, s0 + x * 4, s1 + x * 4, 2);
+	}
+}
+
+/*! \brief converts rows \p y and (y + 1) of the YUV 4:2:0 frame of width \p w into RGB pixels.
+ *  \sa convertPairBGRAtoYUV420()
+ */
+static void convertPairYUV420toRGB(TConvertRowsYUV420toRGB convertRows, uint8_t *rgb, uint8_t *yuv[3], uint32_t w, uint32_t y,
+		const TPixelLayout *layout) {
+	uint8_t *d0 = rgb + y * (w * 4);
+	const uint8_t *y0 = yuv[0] + y * w;
+	const uint8_t *u = yuv[1] + y/2 * (w/2);
+	const uint8_t *v = yuv[2] + y/2 * (w/2);
+	const uint32_t even = w & ~1;
+
+	convertRows(d0, d0 + w * 4, y0, y0 + w, u, v, even, layout);
+
+	if (w & 1) {
+		const uint32_t x = w - 2;
+		convertRows(d0 + x * 4, d0 + (w + x) * 4, y0 + x, y0 + w + x, u + x/2, v + x/2, 2, layout);
+	}
+}
+
+void convertBGRAtoYUV420(uint8_t *yuv[3], uint8_t *src, uint32_t w, uint32_t h) {
+	TConvertRowsBGRAtoYUV420 convertRows = kernels()->convertRowsBGRAtoYUV420;
+
+	// (frames narrower or lower than a pixel pair have no 4:2:0 layout)
+	if (w < 2 || h < 2)
+		return;
+
+	for (uint32_t y = 0; y < h; y += 2) {
+		const uint32_t row = pairRow(y, h);
+		const uint8_t *s0 = src + row * (w * 4);
+
+		convertPairBGRAtoYUV420(convertRows, yuv, w, row, s0, s0 + w * 4);
+	}
+}
+
+void convertYUV420toRGB(uint8_t *rgb, uint8_t *yuv[3], uint32_t w, uint32_t h, const TPixelLayout *layout) {
+	TConvertRowsYUV420toRGB convertRows = kernels()->convertRowsYUV420toRGB;
+
+	// (frames narrower or lower than a pixel pair have no 4:2:0 layout)
+	if (w < 2 || h < 2)
+		return;
+
+	for (uint32_t y = 0; y < h; y += 2)
+		convertPairYUV420toRGB(convertRows, rgb, yuv, w, pairRow(y, h), layout);
+}
+
+struct TPyramid {
+	TScaleRowBGRA scaleRow;
+	const uint8_t *source;				//!< top row of the source frame
+	int32_t stride;						//!< distance between two source rows, in bytes
+	uint32_t width[MAX_SCALE_LEVELS + 1];	//!< row width (in pixels) per level
+	uint32_t height;					//!< source height
+	uint8_t *rows[MAX_SCALE_LEVELS + 1][2];	//!< two rows of scratch per level (except level 0)
+};
+
+/*! \brief computes row \p AY of the given scale level, out of two rows of the level below.
+ *  \param ASlot which of the level's two scratch rows to use
+ */
+static const uint8_t *scaledRow(TPyramid *p, int ALevel, uint32_t AY, int ASlot) {
+	if (ALevel == 0)
+		return p->source + long(AY < p->height ? AY : p->height - 1) * p->stride;
+
+	const uint8_t *s0 = scaledRow(p, ALevel - 1, AY * 2, 0);
+	const uint8_t *s1 = scaledRow(p, ALevel - 1, AY * 2 + 1, 1);
+
+	uint8_t *dst = p->rows[ALevel][ASlot];
+	p->scaleRow(dst, s0, s1, p->width[ALevel - 1]);
+
+	return dst;
+}
+
+void convertBGRAtoYUV420Scaled(uint8_t *yuv[3], const uint8_t *src, int32_t stride, uint32_t w, uint32_t h, int scale, uint8_t *scratch) {
+	const TKernels *k = kernels();
+
+	if (scale > MAX_SCALE_LEVELS)
+		scale = MAX_SCALE_LEVELS;
+
+	TPyramid p;
+	p.scaleRow = k->scaleRowBGRA;
+	p.source = src;
+	p.stride = stride;
+	p.height = h;
+	p.width[0] = w;
+
+	for (int i = 1; i <= scale; ++i)
+		p.width[i] = p.width[i - 1] / 2;
+
+	// (see scaleScratchLength())
+	for (int i = 1, offset = 0; i <= scale; ++i) {
+		for (int j = 0; j < 2; ++j, offset += (p.width[i] + 2) * 4)
+			p.rows[i][j] = scratch + offset;
+	}
+
+	const uint32_t sw = p.width[scale];
+	const uint32_t sh = h >> scale;
+
+	// (frames narrower or lower than a pixel pair have no 4:2:0 layout)
+	if (sw < 2 || sh < 2)
+		return;
+
+	for (uint32_t y = 0; y < sh; y += 2) {
+		const uint32_t row = pairRow(y, sh);
+		const uint8_t *s0 = scaledRow(&p, scale, row, 0);
+		const uint8_t *s1 = scaledRow(&p, scale, row + 1, 1);
+
+		convertPairBGRAtoYUV420(k->convertRowsBGRAtoYUV420, yuv, sw, row, s0, s1);
+	}
+}
+
+void scaleBGRA(unsigned char *buffer, uint32_t width, uint32_t height) {
+	TScaleRowBGRA scaleRow = kernels()->scaleRowBGRA;
+
+	// scales in place, as each destination row lies before its source rows
+	for (uint32_t y = 0; y < height; y += 2) {
+		const uint8_t *s0 = buffer + y * (width * 4);
+
+		scaleRow(buffer + width * y, s0, s0 + width * 4, width);
+	}
+}
+
+// vim:ai:noet:ts=4:nowrap
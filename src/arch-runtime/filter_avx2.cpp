@@ -0,0 +1,143 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (AVX2 row filter kernels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "kernels.h"
+
+#include <string.h>
+
+#if defined(CAPSEO_KERNELS_X86)
+
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+// restores linear element order after in-lane packing
+#define LINEAR(x) _mm256_permute4x64_epi64((x), _MM_SHUFFLE(3, 1, 2, 0))
+
+static inline __m256i select(__m256i mask, __m256i a, __m256i b) {
+	return _mm256_blendv_epi8(a, b, mask);
+}
+
+/*! \brief Paeth predictor of 16 (16 bit) bytes.
+ */
+static inline __m256i paeth16(__m256i a, __m256i b, __m256i c) {
+	const __m256i pa = _mm256_abs_epi16(_mm256_sub_epi16(b, c));
+	const __m256i pb = _mm256_abs_epi16(_mm256_sub_epi16(a, c));
+	const __m256i pc = _mm256_abs_epi16(_mm256_sub_epi16(_mm256_add_epi16(a, b), _mm256_add_epi16(c, c)));
+
+	const __m256i notA = _mm256_or_si256(_mm256_cmpgt_epi16(pa, pb), _mm256_cmpgt_epi16(pa, pc));
+	const __m256i notB = _mm256_cmpgt_epi16(pb, pc);
+
+	return select(notA, a, select(notB, b, c));
+}
+
+static inline __m256i widen(const uint8_t *p) {
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+/*! \brief computes 32 residuals of the bytes at \p x of \p row.
+ */
+template<int AFilter>
+static inline __m256i residualsOf(const uint8_t *row, const uint8_t *above, uint32_t x) {
+	const __m256i cur = _mm256_loadu_si256((const __m256i *)(row + x));
+	const __m256i a = _mm256_loadu_si256((const __m256i *)(row + x - 1));
+	const __m256i b = _mm256_loadu_si256((const __m256i *)(above + x));
+
+	switch (AFilter) {
+		case CAPSEO_FILTER_LEFT:
+			return _mm256_sub_epi8(cur, a);
+		case CAPSEO_FILTER_UP:
+			return _mm256_sub_epi8(cur, b);
+		case CAPSEO_FILTER_AVERAGE: {
+			// (pavgb rounds up, the filter rounds down)
+			const __m256i odd = _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1));
+			return _mm256_sub_epi8(cur, _mm256_sub_epi8(_mm256_avg_epu8(a, b), odd));
+		}
+		case CAPSEO_FILTER_PAETH: {
+			const __m256i lo = paeth16(widen(row + x - 1), widen(above + x), widen(above + x - 1));
+			const __m256i hi = paeth16(widen(row + x + 15), widen(above + x + 16), widen(above + x + 15));
+			return _mm256_sub_epi8(cur, LINEAR(_mm256_packus_epi16(lo, hi)));
+		}
+		default:
+			return cur;
+	}
+}
+
+template<int AFilter>
+static uint32_t filterRow(uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t width) {
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i sum = zero;
+
+	// (the first byte has no left neighbour)
+	uint32_t cost = filterRange_generic(AFilter, dst, row, above, 0, 1);
+
+	uint32_t x = 1;
+	for (; x + 32 <= width; x += 32) {
+		const __m256i r = residualsOf<AFilter>(row, above, x);
+
+		_mm256_storeu_si256((__m256i *)(dst + x), r);
+
+		// magnitudes as signed bytes, i.e. min(r, -r) unsigned
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_min_epu8(r, _mm256_sub_epi8(zero, r)), zero));
+	}
+
+	const __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	cost += _mm_cvtsi128_si32(half) + _mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+
+	return cost + filterRange_generic(AFilter, dst, row, above, x, width);
+}
+
+uint32_t filterRow_avx2(int filter, uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t width) {
+	if (!width)
+		return 0;
+
+	switch (filter) {
+		case CAPSEO_FILTER_LEFT:
+			return filterRow<CAPSEO_FILTER_LEFT>(dst, row, above, width);
+		case CAPSEO_FILTER_UP:
+			return filterRow<CAPSEO_FILTER_UP>(dst, row, above, width);
+		case CAPSEO_FILTER_AVERAGE:
+			return filterRow<CAPSEO_FILTER_AVERAGE>(dst, row, above, width);
+		case CAPSEO_FILTER_PAETH:
+			return filterRow<CAPSEO_FILTER_PAETH>(dst, row, above, width);
+		default:
+			return filterRow<CAPSEO_FILTER_NONE>(dst, row, above, width);
+	}
+}
+
+/*! \brief adds the upper row onto the residuals.
+ */
+static inline void unfilterUp(uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t width) {
+	uint32_t x = 0;
+	for (; x + 32 <= width; x += 32) {
+		const __m256i r = _mm256_loadu_si256((const __m256i *)(residuals + x));
+		const __m256i b = _mm256_loadu_si256((const __m256i *)(above + x));
+
+		_mm256_storeu_si256((__m256i *)(dst + x), _mm256_add_epi8(r, b));
+	}
+
+	unfilterRange_generic(CAPSEO_FILTER_UP, dst, residuals, above, x, width);
+}
+
+/* The left filter's prefix sum gains nothing from lane-crossing 256 bit shifts
+ * over the SSE2 one, while average and Paeth are inherently serial.
+ */
+void unfilterRow_avx2(int filter, uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t width) {
+	if (filter == CAPSEO_FILTER_UP)
+		unfilterUp(dst, residuals, above, width);
+	else
+		unfilterRow_sse2(filter, dst, residuals, above, width);
+}
+
+#endif
+
+// vim:ai:noet:ts=4:nowrap
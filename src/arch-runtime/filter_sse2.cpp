@@ -0,0 +1,181 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (SSE2 row filter kernels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "kernels.h"
+
+#include <string.h>
+
+#if defined(CAPSEO_KERNELS_X86)
+
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+
+static inline __m128i abs16(__m128i x) {
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+/*! \brief selects \p a where \p mask is clear, \p b where it is set.
+ */
+static inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, a));
+}
+
+/*! \brief Paeth predictor of 8 (16 bit) bytes.
+ */
+static inline __m128i paeth8(__m128i a, __m128i b, __m128i c) {
+	const __m128i pa = abs16(_mm_sub_epi16(b, c));
+	const __m128i pb = abs16(_mm_sub_epi16(a, c));
+	const __m128i pc = abs16(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c)));
+
+	const __m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+	const __m128i notB = _mm_cmpgt_epi16(pb, pc);
+
+	return select(notA, a, select(notB, b, c));
+}
+
+/*! \brief Paeth predictor of 16 bytes.
+ */
+static inline __m128i paeth16(__m128i a, __m128i b, __m128i c) {
+	const __m128i zero = _mm_setzero_si128();
+
+	const __m128i lo = paeth8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+	const __m128i hi = paeth8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+
+	return _mm_packus_epi16(lo, hi);
+}
+
+/*! \brief computes 16 residuals of \p cur, \p a, \p b and \p c being its left, upper and upper left neighbours.
+ */
+template<int AFilter>
+static inline __m128i residualsOf(__m128i cur, __m128i a, __m128i b, __m128i c) {
+	switch (AFilter) {
+		case CAPSEO_FILTER_LEFT:
+			return _mm_sub_epi8(cur, a);
+		case CAPSEO_FILTER_UP:
+			return _mm_sub_epi8(cur, b);
+		case CAPSEO_FILTER_AVERAGE: {
+			// (pavgb rounds up, the filter rounds down)
+			const __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+			return _mm_sub_epi8(cur, _mm_sub_epi8(_mm_avg_epu8(a, b), odd));
+		}
+		case CAPSEO_FILTER_PAETH:
+			return _mm_sub_epi8(cur, paeth16(a, b, c));
+		default:
+			return cur;
+	}
+}
+
+template<int AFilter>
+static uint32_t filterRow(uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t width) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum = zero;
+
+	// (the first byte has no left neighbour)
+	uint32_t cost = filterRange_generic(AFilter, dst, row, above, 0, 1);
+
+	uint32_t x = 1;
+	for (; x + 16 <= width; x += 16) {
+		const __m128i r = residualsOf<AFilter>(
+			_mm_loadu_si128((const __m128i *)(row + x)), _mm_loadu_si128((const __m128i *)(row + x - 1)),
+			_mm_loadu_si128((const __m128i *)(above + x)), _mm_loadu_si128((const __m128i *)(above + x - 1)));
+
+		_mm_storeu_si128((__m128i *)(dst + x), r);
+
+		// magnitudes as signed bytes, i.e. min(r, -r) unsigned
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_min_epu8(r, _mm_sub_epi8(zero, r)), zero));
+	}
+
+	cost += _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+
+	return cost + filterRange_generic(AFilter, dst, row, above, x, width);
+}
+
+uint32_t filterRow_sse2(int filter, uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t width) {
+	if (!width)
+		return 0;
+
+	switch (filter) {
+		case CAPSEO_FILTER_LEFT:
+			return filterRow<CAPSEO_FILTER_LEFT>(dst, row, above, width);
+		case CAPSEO_FILTER_UP:
+			return filterRow<CAPSEO_FILTER_UP>(dst, row, above, width);
+		case CAPSEO_FILTER_AVERAGE:
+			return filterRow<CAPSEO_FILTER_AVERAGE>(dst, row, above, width);
+		case CAPSEO_FILTER_PAETH:
+			return filterRow<CAPSEO_FILTER_PAETH>(dst, row, above, width);
+		default:
+			return filterRow<CAPSEO_FILTER_NONE>(dst, row, above, width);
+	}
+}
+
+/*! \brief adds the upper row onto the residuals.
+ */
+static inline void unfilterUp(uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t width) {
+	uint32_t x = 0;
+	for (; x + 16 <= width; x += 16) {
+		const __m128i r = _mm_loadu_si128((const __m128i *)(residuals + x));
+		const __m128i b = _mm_loadu_si128((const __m128i *)(above + x));
+
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_add_epi8(r, b));
+	}
+
+	unfilterRange_generic(CAPSEO_FILTER_UP, dst, residuals, above, x, width);
+}
+
+/*! \brief sums up the residuals from the left, 16 bytes at a time.
+ */
+static inline void unfilterLeft(uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t width) {
+	__m128i carry = _mm_setzero_si128();
+
+	uint32_t x = 0;
+	for (; x + 16 <= width; x += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(residuals + x));
+
+		// prefix sum within the vector
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi8(v, carry);
+
+		_mm_storeu_si128((__m128i *)(dst + x), v);
+
+		// broadcast the last byte
+		carry = _mm_unpackhi_epi8(v, v);
+		carry = _mm_unpackhi_epi16(carry, carry);
+		carry = _mm_shuffle_epi32(carry, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	unfilterRange_generic(CAPSEO_FILTER_LEFT, dst, residuals, above, x, width);
+}
+
+/* The average and Paeth filters predict each byte from its reconstructed left
+ * neighbour, which leaves nothing to vectorize with a single byte per pixel.
+ */
+void unfilterRow_sse2(int filter, uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t width) {
+	switch (filter) {
+		case CAPSEO_FILTER_LEFT:
+			unfilterLeft(dst, residuals, above, width);
+			break;
+		case CAPSEO_FILTER_UP:
+			unfilterUp(dst, residuals, above, width);
+			break;
+		default:
+			unfilterRow_generic(filter, dst, residuals, above, width);
+			break;
+	}
+}
+
+#endif
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,96 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (generic row kernels, fallback for the runtime dispatched ones)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This code is based on seom:
+//      (http://neopsis.com/projects/seom/)
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "kernels.h"
+
+#define ri 2
+#define gi 1
+#define bi 0
+
+#define SCALE 8
+#define F(x) ((uint16_t) ((x) * (1L << SCALE) + 0.5))
+
+static const uint16_t m[3][3] = {
+	{ F(0.098), F(0.504), F(0.257) },
+	{ F(0.439), F(0.291), F(0.148) },
+	{ F(0.071), F(0.368), F(0.439) }
+};
+
+// computes the y component of the BGRA pixel at p
+#define SY(p) \
+	(uint8_t) (((m[0][ri] * (p)[ri] + m[0][gi] * (p)[gi] + m[0][bi] * (p)[bi]) >> SCALE) + 16)
+
+void convertRowsBGRAtoYUV420_generic(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		const uint8_t *s0, const uint8_t *s1, uint32_t width) {
+	for (uint32_t x = 0; x < width; x += 2, s0 += 8, s1 += 8) {
+		*y0++ = SY(s0);
+		*y0++ = SY(s0 + 4);
+		*y1++ = SY(s1);
+		*y1++ = SY(s1 + 4);
+
+		// sum up all blue, green and red components of the 2x2 pixels
+		const int r[3] = {
+			s0[0] + s0[4] + s1[0] + s1[4], // blue
+			s0[1] + s0[5] + s1[1] + s1[5], // green
+			s0[2] + s0[6] + s1[2] + s1[6], // red
+		};
+
+		*u++ = (uint8_t) ((-m[1][ri] * r[ri] - m[1][gi] * r[gi] + m[1][bi] * r[bi]) >> (SCALE + 2)) + 128;
+		*v++ = (uint8_t) ((m[2][ri] * r[ri] - m[2][gi] * r[gi] - m[2][bi] * r[bi]) >> (SCALE + 2)) + 128;
+	}
+}
+
+void scaleRowBGRA_generic(uint8_t *dst, const uint8_t *s0, const uint8_t *s1, uint32_t width) {
+	for (uint32_t x = 0; x < width; x += 2, s0 += 8, s1 += 8, dst += 4) {
+		dst[0] = (s0[0] + s0[4] + s1[0] + s1[4]) / 4; // B
+		dst[1] = (s0[1] + s0[5] + s1[1] + s1[5]) / 4; // G
+		dst[2] = (s0[2] + s0[6] + s1[2] + s1[6]) / 4; // R
+		// do not copy the alpha value as it shall always be 0xFF
+	}
+}
+
+static inline uint8_t clip(int x) {
+	return x < 0 ? 0 : x > 255 ? 255 : uint8_t(x);
+}
+
+// stores the pixel of luma l and the chroma terms cr, cg, cb (ITU-R BT.601, 8 bit fixed point)
+static inline void putPixel(uint8_t *dst, int l, int cr, int cg, int cb, const TPixelLayout *layout) {
+	const int c = 298 * (l - 16);
+
+	dst[layout->r] = clip((c + cr) >> 8);
+	dst[layout->g] = clip((c + cg) >> 8);
+	dst[layout->b] = clip((c + cb) >> 8);
+	dst[layout->a] = 0xFF;
+}
+
+void convertRowsYUV420toRGB_generic(uint8_t *d0, uint8_t *d1, const uint8_t *y0, const uint8_t *y1,
+		const uint8_t *u, const uint8_t *v, uint32_t width, const TPixelLayout *layout) {
+	for (uint32_t x = 0; x < width; x += 2, d0 += 8, d1 += 8, y0 += 2, y1 += 2) {
+		const int d = *u++ - 128;
+		const int e = *v++ - 128;
+
+		const int cr = 409 * e + 128;
+		const int cg = 128 - 100 * d - 208 * e;
+		const int cb = 516 * d + 128;
+
+		putPixel(d0, y0[0], cr, cg, cb, layout);
+		putPixel(d0 + 4, y0[1], cr, cg, cb, layout);
+		putPixel(d1, y1[0], cr, cg, cb, layout);
+		putPixel(d1 + 4, y1[1], cr, cg, cb, layout);
+	}
+}
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,77 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (runtime dispatched row kernels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#ifndef capseo_kernels_h
+#define capseo_kernels_h
+
+#include "capseo_private.h"
+#include "filter.h"
+#include "blend.h"
+
+/* The colour conversion kernels operate on a pair of source rows at a time.
+ * All kernels must produce bit-exact results compared to the generic implementation
+ * (the row filter and blending ones being found in filter.h and blend.h).
+ */
+
+/*! converts two BGRA rows of \p width pixels into two Y rows and one U and V row. */
+typedef void (*TConvertRowsBGRAtoYUV420)(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+	const uint8_t *s0, const uint8_t *s1, uint32_t width);
+
+/*! downscales two BGRA rows of \p width pixels into one row of (width / 2) pixels,
+ *  leaving the alpha components of \p dst untouched. */
+typedef void (*TScaleRowBGRA)(uint8_t *dst, const uint8_t *s0, const uint8_t *s1, uint32_t width);
+
+/*! converts two Y rows and their U and V row of \p width pixels into two rows of RGB pixels. */
+typedef void (*TConvertRowsYUV420toRGB)(uint8_t *d0, uint8_t *d1, const uint8_t *y0, const uint8_t *y1,
+	const uint8_t *u, const uint8_t *v, uint32_t width, const TPixelLayout *layout);
+
+void convertRowsBGRAtoYUV420_generic(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+	const uint8_t *s0, const uint8_t *s1, uint32_t width);
+void scaleRowBGRA_generic(uint8_t *dst, const uint8_t *s0, const uint8_t *s1, uint32_t width);
+void convertRowsYUV420toRGB_generic(uint8_t *d0, uint8_t *d1, const uint8_t *y0, const uint8_t *y1,
+	const uint8_t *u, const uint8_t *v, uint32_t width, const TPixelLayout *layout);
+
+#if defined(__i386__) || defined(__x86_64__)
+# define CAPSEO_KERNELS_X86 (1)
+
+void convertRowsBGRAtoYUV420_sse2(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+	const uint8_t *s0, const uint8_t *s1, uint32_t width);
+void scaleRowBGRA_sse2(uint8_t *dst, const uint8_t *s0, const uint8_t *s1, uint32_t width);
+void convertRowsYUV420toRGB_sse2(uint8_t *d0, uint8_t *d1, const uint8_t *y0, const uint8_t *y1,
+	const uint8_t *u, const uint8_t *v, uint32_t width, const TPixelLayout *layout);
+uint32_t filterRow_sse2(int filter, uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t width);
+void unfilterRow_sse2(int filter, uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t width);
+void blendRow_sse2(uint8_t *dst, const uint8_t *premultiplied, const uint8_t *transparency, uint32_t width);
+
+void convertRowsBGRAtoYUV420_avx2(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+	const uint8_t *s0, const uint8_t *s1, uint32_t width);
+void scaleRowBGRA_avx2(uint8_t *dst, const uint8_t *s0, const uint8_t *s1, uint32_t width);
+void convertRowsYUV420toRGB_avx2(uint8_t *d0, uint8_t *d1, const uint8_t *y0, const uint8_t *y1,
+	const uint8_t *u, const uint8_t *v, uint32_t width, const TPixelLayout *layout);
+uint32_t filterRow_avx2(int filter, uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t width);
+void unfilterRow_avx2(int filter, uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t width);
+void blendRow_avx2(uint8_t *dst, const uint8_t *premultiplied, const uint8_t *transparency, uint32_t width);
+#endif
+
+struct TKernels {
+	const char *name;
+	TConvertRowsBGRAtoYUV420 convertRowsBGRAtoYUV420;
+	TScaleRowBGRA scaleRowBGRA;
+	TConvertRowsYUV420toRGB convertRowsYUV420toRGB;
+	TFilterKernels filter;
+	TBlendKernels blend;
+};
+
+const TKernels *kernels();
+
+#endif
@@ -0,0 +1,225 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (SSE2 row kernels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "kernels.h"
+
+#if defined(CAPSEO_KERNELS_X86)
+
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+
+/*! \brief splits 8 BGRA pixels into their 16 bit blue, green and red components.
+ */
+static inline void unpackBGR(const uint8_t *src, __m128i& b, __m128i& g, __m128i& r) {
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i p0 = _mm_loadu_si128((const __m128i *)src);
+	const __m128i p1 = _mm_loadu_si128((const __m128i *)(src + 16));
+
+	b = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+	r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+/*! \brief computes 8 luma values out of the 16 bit colour components.
+ *
+ *  The weighted sum never exceeds 16 bits (unsigned), so it is safe to compute it
+ *  with wrapping 16 bit arithmetic.
+ */
+static inline __m128i lumaOf(__m128i b, __m128i g, __m128i r) {
+	__m128i y = _mm_mullo_epi16(b, _mm_set1_epi16(25));
+	y = _mm_add_epi16(y, _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+	y = _mm_add_epi16(y, _mm_mullo_epi16(r, _mm_set1_epi16(66)));
+
+	return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+}
+
+/*! \brief computes 4 chroma values (as 32 bit integers) out of 4 2x2 colour component sums.
+ *  \param bg interleaved (blue, green) sums
+ *  \param r0 interleaved (red, 0) sums
+ */
+static inline __m128i chromaOf(__m128i bg, __m128i r0, __m128i cbg, __m128i cr) {
+	__m128i c = _mm_add_epi32(_mm_madd_epi16(bg, cbg), _mm_madd_epi16(r0, cr));
+	return _mm_add_epi32(_mm_srai_epi32(c, 10), _mm_set1_epi32(128));
+}
+
+void convertRowsBGRAtoYUV420_sse2(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		const uint8_t *s0, const uint8_t *s1, uint32_t width) {
+	const __m128i ones = _mm_set1_epi16(1);
+	const __m128i zero = _mm_setzero_si128();
+
+	// (blue, green) and (red, 0) coefficients of u and v
+	const __m128i ubg = _mm_setr_epi16(112, -74, 112, -74, 112, -74, 112, -74);
+	const __m128i ur = _mm_setr_epi16(-38, 0, -38, 0, -38, 0, -38, 0);
+	const __m128i vbg = _mm_setr_epi16(-18, -94, -18, -94, -18, -94, -18, -94);
+	const __m128i vr = _mm_setr_epi16(112, 0, 112, 0, 112, 0, 112, 0);
+
+	uint32_t x = 0;
+	for (; x + 8 <= width; x += 8, s0 += 32, s1 += 32, y0 += 8, y1 += 8, u += 4, v += 4) {
+		__m128i b0, g0, r0, b1, g1, r1;
+		unpackBGR(s0, b0, g0, r0);
+		unpackBGR(s1, b1, g1, r1);
+
+		_mm_storel_epi64((__m128i *)y0, _mm_packus_epi16(lumaOf(b0, g0, r0), zero));
+		_mm_storel_epi64((__m128i *)y1, _mm_packus_epi16(lumaOf(b1, g1, r1), zero));
+
+		// 2x2 sums, as 32 bit integers
+		const __m128i bs = _mm_madd_epi16(_mm_add_epi16(b0, b1), ones);
+		const __m128i gs = _mm_madd_epi16(_mm_add_epi16(g0, g1), ones);
+		const __m128i rs = _mm_madd_epi16(_mm_add_epi16(r0, r1), ones);
+
+		// (sums fit into 16 bits, so interleave them as 16 bit pairs for pmaddwd)
+		const __m128i bg = _mm_or_si128(bs, _mm_slli_epi32(gs, 16));
+
+		const __m128i uc = chromaOf(bg, rs, ubg, ur);
+		const __m128i vc = chromaOf(bg, rs, vbg, vr);
+
+		const __m128i uv = _mm_packus_epi16(_mm_packs_epi32(uc, vc), zero);
+		*(uint32_t *)u = _mm_cvtsi128_si32(uv);
+		*(uint32_t *)v = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+	}
+
+	if (x < width)
+		convertRowsBGRAtoYUV420_generic(y0, y1, u, v, s0, s1, width - x);
+}
+
+/*! \brief sums up the even and odd pixels of the 8 BGRA pixels at src, per component.
+ */
+static inline void sumPairs(const uint8_t *src, __m128i& lo, __m128i& hi) {
+	const __m128 p0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)src));
+	const __m128 p1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(src + 16)));
+
+	const __m128i even = _mm_castps_si128(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0)));
+	const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1)));
+	const __m128i zero = _mm_setzero_si128();
+
+	lo = _mm_add_epi16(_mm_unpacklo_epi8(even, zero), _mm_unpacklo_epi8(odd, zero));
+	hi = _mm_add_epi16(_mm_unpackhi_epi8(even, zero), _mm_unpackhi_epi8(odd, zero));
+}
+
+void scaleRowBGRA_sse2(uint8_t *dst, const uint8_t *s0, const uint8_t *s1, uint32_t width) {
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+
+	uint32_t x = 0;
+	for (; x + 8 <= width; x += 8, s0 += 32, s1 += 32, dst += 16) {
+		__m128i lo0, hi0, lo1, hi1;
+		sumPairs(s0, lo0, hi0);
+		sumPairs(s1, lo1, hi1);
+
+		const __m128i lo = _mm_srli_epi16(_mm_add_epi16(lo0, lo1), 2);
+		const __m128i hi = _mm_srli_epi16(_mm_add_epi16(hi0, hi1), 2);
+
+		// keep the destination's alpha components
+		const __m128i scaled = _mm_andnot_si128(alpha, _mm_packus_epi16(lo, hi));
+		const __m128i old = _mm_and_si128(alpha, _mm_loadu_si128((const __m128i *)dst));
+
+		_mm_storeu_si128((__m128i *)dst, _mm_or_si128(scaled, old));
+	}
+
+	if (x < width)
+		scaleRowBGRA_generic(dst, s0, s1, width - x);
+}
+
+/*! \brief spreads 8 chroma terms (as 32 bit integers) over the 16 pixels sharing them.
+ */
+static inline void spread(__m128i lo, __m128i hi, __m128i c[4]) {
+	c[0] = _mm_unpacklo_epi32(lo, lo);
+	c[1] = _mm_unpackhi_epi32(lo, lo);
+	c[2] = _mm_unpacklo_epi32(hi, hi);
+	c[3] = _mm_unpackhi_epi32(hi, hi);
+}
+
+/*! \brief computes the luma terms (as 32 bit integers) of the 16 pixels at src.
+ */
+static inline void lumaTerms(const uint8_t *src, __m128i l[4]) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c298 = _mm_set1_epi32(298); // (298, 0) pairs
+	const __m128i y = _mm_loadu_si128((const __m128i *)src);
+	const __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(y, zero), _mm_set1_epi16(16));
+	const __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(y, zero), _mm_set1_epi16(16));
+
+	l[0] = _mm_madd_epi16(_mm_unpacklo_epi16(lo, zero), c298);
+	l[1] = _mm_madd_epi16(_mm_unpackhi_epi16(lo, zero), c298);
+	l[2] = _mm_madd_epi16(_mm_unpacklo_epi16(hi, zero), c298);
+	l[3] = _mm_madd_epi16(_mm_unpackhi_epi16(hi, zero), c298);
+}
+
+/*! \brief computes a colour component of 16 pixels out of their luma and chroma terms, clipped to 8 bits.
+ */
+static inline __m128i componentOf(const __m128i l[4], const __m128i c[4]) {
+	const __m128i lo = _mm_packs_epi32(
+		_mm_srai_epi32(_mm_add_epi32(l[0], c[0]), 8),
+		_mm_srai_epi32(_mm_add_epi32(l[1], c[1]), 8));
+	const __m128i hi = _mm_packs_epi32(
+		_mm_srai_epi32(_mm_add_epi32(l[2], c[2]), 8),
+		_mm_srai_epi32(_mm_add_epi32(l[3], c[3]), 8));
+
+	return _mm_packus_epi16(lo, hi);
+}
+
+/*! \brief interleaves the colour components of 16 pixels as given by the layout and stores them.
+ */
+static inline void storePixels(uint8_t *dst, __m128i r, __m128i g, __m128i b, const TPixelLayout *layout) {
+	__m128i p[4];
+	p[layout->r] = r;
+	p[layout->g] = g;
+	p[layout->b] = b;
+	p[layout->a] = _mm_set1_epi8(-1);
+
+	const __m128i lo01 = _mm_unpacklo_epi8(p[0], p[1]);
+	const __m128i hi01 = _mm_unpackhi_epi8(p[0], p[1]);
+	const __m128i lo23 = _mm_unpacklo_epi8(p[2], p[3]);
+	const __m128i hi23 = _mm_unpackhi_epi8(p[2], p[3]);
+
+	_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(hi01, hi23));
+	_mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(hi01, hi23));
+}
+
+void convertRowsYUV420toRGB_sse2(uint8_t *d0, uint8_t *d1, const uint8_t *y0, const uint8_t *y1,
+		const uint8_t *u, const uint8_t *v, uint32_t width, const TPixelLayout *layout) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i half = _mm_set1_epi32(128);
+
+	// (u, v) coefficients of the red, green and blue chroma terms
+	const __m128i cr = _mm_setr_epi16(0, 409, 0, 409, 0, 409, 0, 409);
+	const __m128i cg = _mm_setr_epi16(-100, -208, -100, -208, -100, -208, -100, -208);
+	const __m128i cb = _mm_setr_epi16(516, 0, 516, 0, 516, 0, 516, 0);
+
+	uint32_t x = 0;
+	for (; x + 16 <= width; x += 16, d0 += 64, d1 += 64, y0 += 16, y1 += 16, u += 8, v += 8) {
+		const __m128i d = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)u), zero), _mm_set1_epi16(128));
+		const __m128i e = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)v), zero), _mm_set1_epi16(128));
+		const __m128i delo = _mm_unpacklo_epi16(d, e);
+		const __m128i dehi = _mm_unpackhi_epi16(d, e);
+
+		__m128i r[4], g[4], b[4];
+		spread(_mm_add_epi32(_mm_madd_epi16(delo, cr), half), _mm_add_epi32(_mm_madd_epi16(dehi, cr), half), r);
+		spread(_mm_add_epi32(_mm_madd_epi16(delo, cg), half), _mm_add_epi32(_mm_madd_epi16(dehi, cg), half), g);
+		spread(_mm_add_epi32(_mm_madd_epi16(delo, cb), half), _mm_add_epi32(_mm_madd_epi16(dehi, cb), half), b);
+
+		__m128i l[4];
+		lumaTerms(y0, l);
+		storePixels(d0, componentOf(l, r), componentOf(l, g), componentOf(l, b), layout);
+
+		lumaTerms(y1, l);
+		storePixels(d1, componentOf(l, r), componentOf(l, g), componentOf(l, b), layout);
+	}
+
+	if (x < width)
+		convertRowsYUV420toRGB_generic(d0, d1, y0, y1, u, v, width - x, layout);
+}
+
+#endif
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,347 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (asynchronous stream encoder)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo.h"
+#include "capseo_private.h"
+
+#include <pthread.h>
+#include <string.h>
+
+/* The asynchronous stream encoder is a pipeline of three stages working on
+ * a ring of frame slots:
+ *
+ *  1. the capturing thread copies the raw frame into the next free slot
+ *  2. the encoder thread converts and compresses filled slots, in order
+ *  3. the writer thread writes encoded slots to the stream, in order
+ *
+ * The encoder stage is a single thread, as (delta) encoding depends on the
+ * previous frame; sliced formats still compress on their worker pool though.
+ */
+
+enum TSlotState {
+	SLOT_FREE,
+	SLOT_FILLED,
+	SLOT_ENCODED
+};
+
+struct TAsyncSlot {
+	TSlotState state;
+
+	capseo_frame_id_t id;
+	uint8_t *frame;						//!< raw frame copy
+	int flags;							//!< input flags of the frame copy
+
+	bool hasCursor;
+	capseo_cursor_t cursor;				//!< cursor copy
+	unsigned cursorBufferLength;
+
+	uint8_t *encodedBuffer;
+	int encodedBufferLength;
+	int encodedLength;
+};
+
+struct TCapseoAsyncEncoder {
+	capseo_stream_t *stream;
+
+	TAsyncSlot *slots;
+	int slotCount;
+	unsigned frameLength;				//!< raw frame length
+
+	int fillIndex;						//!< next slot to fill
+	int encodeIndex;					//!< next slot to encode
+	int writeIndex;						//!< next slot to write
+
+	pthread_mutex_t lock;
+	pthread_cond_t slotFreed;
+	pthread_cond_t slotFilled;
+	pthread_cond_t slotEncoded;
+
+	pthread_t encoderThread;
+	pthread_t writerThread;
+	bool encoderRunning;
+	bool writerRunning;
+
+	bool quit;							//!< no more frames will be submitted
+	bool encoderDone;					//!< encoder thread has encoded all submitted frames
+	int error;							//!< first error happened in background, if any
+
+	uint64_t submitted;
+	uint64_t written;
+	uint64_t dropped;
+};
+
+static void *encoderMain(void *AHandle) {
+	TCapseoAsyncEncoder *async = (TCapseoAsyncEncoder *)AHandle;
+	capseo_t *cs = &async->stream->frameHandle;
+
+	pthread_mutex_lock(&async->lock);
+	for (;;) {
+		TAsyncSlot *slot = &async->slots[async->encodeIndex];
+
+		while (!async->quit && slot->state != SLOT_FILLED)
+			pthread_cond_wait(&async->slotFilled, &async->lock);
+
+		if (slot->state != SLOT_FILLED)
+			break;
+
+		pthread_mutex_unlock(&async->lock);
+
+		capseo_cursor_t *cursor = slot->hasCursor ? &slot->cursor : 0;
+
+		// encode right into the slot
+		const int bound = CapseoEncodeFrameBound(cs, cursor);
+		if (bound > slot->encodedBufferLength) {
+			delete[] slot->encodedBuffer;
+			slot->encodedBuffer = new uint8_t[bound];
+			slot->encodedBufferLength = bound;
+		}
+
+		int error = CapseoEncodeFrameInto(cs, slot->frame, 0, slot->flags, slot->id, cursor,
+			slot->encodedBuffer, slot->encodedBufferLength, &slot->encodedLength);
+
+		pthread_mutex_lock(&async->lock);
+
+		if (error) {
+			if (!async->error)
+				async->error = error;
+
+			slot->encodedLength = 0;
+		}
+
+		slot->state = SLOT_ENCODED;
+		async->encodeIndex = (async->encodeIndex + 1) % async->slotCount;
+		pthread_cond_signal(&async->slotEncoded);
+	}
+	async->encoderDone = true;
+	pthread_cond_signal(&async->slotEncoded);
+	pthread_mutex_unlock(&async->lock);
+
+	return 0;
+}
+
+static void *writerMain(void *AHandle) {
+	TCapseoAsyncEncoder *async = (TCapseoAsyncEncoder *)AHandle;
+
+	pthread_mutex_lock(&async->lock);
+	for (;;) {
+		TAsyncSlot *slot = &async->slots[async->writeIndex];
+
+		while (!async->encoderDone && slot->state != SLOT_ENCODED)
+			pthread_cond_wait(&async->slotEncoded, &async->lock);
+
+		if (slot->state != SLOT_ENCODED)
+			break;
+
+		// once the pipeline failed, the remaining frames are discarded rather than appended to a broken stream
+		if (slot->encodedLength && !async->error) {
+			pthread_mutex_unlock(&async->lock);
+
+			int error = writeStreamFrame(async->stream, slot->encodedBuffer, slot->encodedLength);
+
+			pthread_mutex_lock(&async->lock);
+
+			if (error && !async->error)
+				async->error = error;
+			else if (!error)
+				++async->written;
+		}
+
+		slot->state = SLOT_FREE;
+		async->writeIndex = (async->writeIndex + 1) % async->slotCount;
+		pthread_cond_signal(&async->slotFreed);
+	}
+	pthread_mutex_unlock(&async->lock);
+
+	return 0;
+}
+
+/*! \brief creates the asynchronous encoder pipeline for the given encoding stream.
+ *  \param stream the encoding stream
+ *  \param ASlots number of frame slots to buffer
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_SYSTEM could not create threads
+ */
+int createAsyncEncoder(capseo_stream_t *stream, int ASlots) {
+	const capseo_info_t& info = stream->frameHandle.info;
+
+	TCapseoAsyncEncoder *async = new TCapseoAsyncEncoder;
+	bzero(async, sizeof(*async));
+
+	async->stream = stream;
+	async->slotCount = ASlots;
+	async->frameLength = info.format == CAPSEO_FORMAT_YUV420
+		? info.width * info.height * 3 / 2
+		: info.width * info.height * 4;
+	async->slots = new TAsyncSlot[ASlots];
+
+	for (int i = 0; i < ASlots; ++i) {
+		TAsyncSlot *slot = &async->slots[i];
+		bzero(slot, sizeof(*slot));
+
+		slot->state = SLOT_FREE;
+		slot->frame = new uint8_t[async->frameLength];
+		slot->encodedBufferLength = CapseoEncodeFrameBound(&stream->frameHandle, 0);
+		slot->encodedBuffer = new uint8_t[slot->encodedBufferLength];
+	}
+
+	pthread_mutex_init(&async->lock, 0);
+	pthread_cond_init(&async->slotFreed, 0);
+	pthread_cond_init(&async->slotFilled, 0);
+	pthread_cond_init(&async->slotEncoded, 0);
+
+	stream->async = async;
+
+	async->encoderRunning = pthread_create(&async->encoderThread, 0, &encoderMain, async) == 0;
+	async->writerRunning = async->encoderRunning
+		&& pthread_create(&async->writerThread, 0, &writerMain, async) == 0;
+
+	if (!async->writerRunning) {
+		destroyAsyncEncoder(stream);
+		return CAPSEO_E_SYSTEM;
+	}
+
+	return CAPSEO_SUCCESS;
+}
+
+/*! \brief flushes all pending frames to the stream and destructs the asynchronous encoder.
+ */
+void destroyAsyncEncoder(capseo_stream_t *stream) {
+	TCapseoAsyncEncoder *async = stream->async;
+
+	pthread_mutex_lock(&async->lock);
+	async->quit = true;
+	pthread_cond_signal(&async->slotFilled);
+	pthread_mutex_unlock(&async->lock);
+
+	// the threads drain all pending slots before they leave
+	if (async->encoderRunning)
+		pthread_join(async->encoderThread, 0);
+
+	if (async->writerRunning)
+		pthread_join(async->writerThread, 0);
+
+	pthread_cond_destroy(&async->slotEncoded);
+	pthread_cond_destroy(&async->slotFilled);
+	pthread_cond_destroy(&async->slotFreed);
+	pthread_mutex_destroy(&async->lock);
+
+	for (int i = 0; i < async->slotCount; ++i) {
+		delete[] async->slots[i].frame;
+		delete[] async->slots[i].cursor.buffer;
+		delete[] async->slots[i].encodedBuffer;
+	}
+	delete[] async->slots;
+
+	delete async;
+	stream->async = 0;
+}
+
+/*! \brief copies the given raw frame into a slot's tightly packed frame buffer.
+ *
+ *  The rows are kept in their order, leaving a flip to the colour conversion.
+ */
+static void copyFrame(TCapseoAsyncEncoder *async, uint8_t *dst, const uint8_t *src, int stride) {
+	const capseo_info_t& info = async->stream->frameHandle.info;
+	const int rowLength = info.width * 4;
+
+	if (info.format != CAPSEO_FORMAT_BGRA || stride == rowLength) {
+		memcpy(dst, src, async->frameLength);
+		return;
+	}
+
+	for (int y = 0; y < info.height; ++y, src += stride, dst += rowLength)
+		memcpy(dst, src, rowLength);
+}
+
+/*! \brief hands over a frame to the asynchronous encoder.
+ *  \retval CAPSEO_SUCCESS the frame has been queued (or dropped, according to the drop policy)
+ *  \return or any error that happened while encoding or writing a previous frame
+ */
+int submitAsyncFrame(capseo_stream_t *stream, const uint8_t *frame, int stride, int flags, capseo_frame_id_t id, capseo_cursor_t *cursor) {
+	TCapseoAsyncEncoder *async = stream->async;
+	const capseo_info_t& info = stream->frameHandle.info;
+
+	// validate the input layout up front, as the encoder only sees the packed copy
+	if (info.format == CAPSEO_FORMAT_BGRA) {
+		if (!stride)
+			stride = info.width * 4;
+		else if (stride < info.width * 4)
+			return CAPSEO_E_INVALID_ARGUMENT;
+	} else if ((stride && stride != info.width) || flipsInput(&info, flags)) {
+		return CAPSEO_E_NOT_SUPPORTED;
+	}
+
+	pthread_mutex_lock(&async->lock);
+
+	if (int error = async->error) {
+		pthread_mutex_unlock(&async->lock);
+		return error;
+	}
+
+	TAsyncSlot *slot = &async->slots[async->fillIndex];
+
+	if (slot->state != SLOT_FREE && info.async_policy == CAPSEO_ASYNC_DROP) {
+		++async->dropped;
+		pthread_mutex_unlock(&async->lock);
+		return CAPSEO_SUCCESS;
+	}
+
+	while (slot->state != SLOT_FREE)
+		pthread_cond_wait(&async->slotFreed, &async->lock);
+
+	pthread_mutex_unlock(&async->lock);
+
+	// the slot is exclusively ours until marked as filled
+	slot->id = id;
+	slot->flags = flags;
+	copyFrame(async, slot->frame, frame, stride);
+
+	slot->hasCursor = cursor && cursor->buffer;
+	if (slot->hasCursor) {
+		const unsigned length = cursor->width * cursor->height * 4;
+		uint8_t *buffer = slot->cursor.buffer;
+
+		if (length > slot->cursorBufferLength) {
+			delete[] buffer;
+			buffer = new uint8_t[length];
+			slot->cursorBufferLength = length;
+		}
+
+		slot->cursor = *cursor;
+		slot->cursor.buffer = buffer;
+		memcpy(buffer, cursor->buffer, length);
+	}
+
+	pthread_mutex_lock(&async->lock);
+	slot->state = SLOT_FILLED;
+	async->fillIndex = (async->fillIndex + 1) % async->slotCount;
+	++async->submitted;
+	pthread_cond_signal(&async->slotFilled);
+	pthread_mutex_unlock(&async->lock);
+
+	return CAPSEO_SUCCESS;
+}
+
+/*! \brief retrieves the asynchronous encoder's frame counters.
+ */
+void getAsyncStats(capseo_stream_t *stream, capseo_stream_stats_t *stats) {
+	TCapseoAsyncEncoder *async = stream->async;
+
+	pthread_mutex_lock(&async->lock);
+	stats->submitted = async->submitted;
+	stats->written = async->written;
+	stats->dropped = async->dropped;
+	pthread_mutex_unlock(&async->lock);
+}
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,27 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (alpha blending kernels, e.g. for drawing the cursor)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "blend.h"
+
+// {{{ generic kernels
+void blendRow_generic(uint8_t *dst, const uint8_t *premultiplied, const uint8_t *transparency, uint32_t width) {
+	for (uint32_t x = 0; x < width; ++x) {
+		// (exact rounded division by 255)
+		const unsigned t = dst[x] * transparency[x] + 128;
+
+		dst[x] = premultiplied[x] + ((t + (t >> 8)) >> 8);
+	}
+}
+// }}}
+
+// vim:ai:noet:ts=4:nowrap
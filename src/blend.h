@@ -0,0 +1,35 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (alpha blending kernels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#ifndef capseo_blend_h
+#define capseo_blend_h
+
+#include "capseo_private.h"
+
+/* All kernels must produce bit-exact results compared to the generic implementation.
+ */
+
+/*! blends a row of \p width premultiplied bytes over \p dst, i.e.
+ *  dst = premultiplied + round(dst * transparency / 255). */
+typedef void (*TBlendRow)(uint8_t *dst, const uint8_t *premultiplied, const uint8_t *transparency, uint32_t width);
+
+void blendRow_generic(uint8_t *dst, const uint8_t *premultiplied, const uint8_t *transparency, uint32_t width);
+
+struct TBlendKernels {
+	TBlendRow blendRow;
+};
+
+/*! retrieves the blending kernels to use, as chosen by the accel library (see arch-*) */
+const TBlendKernels *blendKernels();
+
+#endif
@@ -30,13 +30,25 @@
 #define CAPSEO_FORMAT_ARGB		0x1203
 #define CAPSEO_FORMAT_ABGR		0x1204
 #define CAPSEO_FORMAT_YUV420	0x1210
+#define CAPSEO_FORMAT_Y8		0x1211	/*!< luma plane only (decoding only), e.g. for thumbnails */
 
 /* (ideally) supported encoded frame fromats (frame and cursor) */
 #define CAPSEO_FORMAT_ENCORE_QLZYUV420	(0x1301)	/*!< quicklz compressed YUV 4:2:0 */
-#define CAPSEO_FORMAT_ENCORE_HUFFYUV	(0x1302)	/*!< HUFFYUV */
+#define CAPSEO_FORMAT_ENCORE_HUFFYUV	(0x1302)	/*!< HuffYUV style predicted and Huffman coded YUV 4:2:0 */
 #define CAPSEO_FORMAT_ENCORE_MJPEG		(0x1303)	/*!< MJPEG */
+#define CAPSEO_FORMAT_ENCORE_QLZDYUV420	(0x1304)	/*!< quicklz compressed YUV 4:2:0, XOR delta against previous frame */
+#define CAPSEO_FORMAT_ENCORE_QLZTYUV420	(0x1305)	/*!< quicklz compressed YUV 4:2:0, changed tiles only */
+#define CAPSEO_FORMAT_ENCORE_QLZSYUV420	(0x1306)	/*!< quicklz compressed YUV 4:2:0, in independent slices */
+#define CAPSEO_FORMAT_ENCORE_QLZFYUV420	(0x1307)	/*!< quicklz compressed YUV 4:2:0, PNG style row filtered */
+#define CAPSEO_FORMAT_ENCORE_QLZPYUV420	(0x1308)	/*!< quicklz compressed YUV 4:2:0, each plane independently */
 #define CAPSEO_FORMAT_ENCORE_ARGB		(0x1350)	/*!< ARGB (e.g. for cursor frames) */
 #define CAPSEO_FORMAT_ENCORE_QLZARGB	(0x1351)	/*!< quicklz compressed ARGB */
+#define CAPSEO_FORMAT_ENCORE_QLZCARGB	(0x1352)	/*!< quicklz compressed ARGB, shapes cached by content (default) */
+
+/* compression backends of the (ideally quicklz compressed) encoded formats */
+#define CAPSEO_COMPRESSION_QUICKLZ		(0x00)		/*!< QuickLZ (default) */
+#define CAPSEO_COMPRESSION_LZ4			(0x01)		/*!< LZ4 block format */
+#define CAPSEO_COMPRESSION_NONE			(0x02)		/*!< stored uncompressed */
 
 /* error codes */
 #define CAPSEO_E_SUCCESS			(0)			/*!< operation performed as expected */
@@ -52,6 +64,17 @@
 
 #define CAPSEO_STREAM_END			(0x101)		/*!< decoding: stream end reached */
 
+/* raw input frame flags */
+#define CAPSEO_INPUT_BOTTOM_UP		(0x01)		/*!< rows are stored bottom-up, e.g. as read by glReadPixels() */
+
+/* row order of the frames stored in a stream */
+#define CAPSEO_ORIENTATION_BOTTOM_UP	(0)		/*!< bottom-up, as read by glReadPixels() (streams of header revision 1) */
+#define CAPSEO_ORIENTATION_TOP_DOWN		(1)		/*!< top-down, e.g. as expected by y4m or theora */
+
+/* asynchronous stream encoder policies, when all frame slots are in use */
+#define CAPSEO_ASYNC_BLOCK			(0)			/*!< wait for a free frame slot */
+#define CAPSEO_ASYNC_DROP			(1)			/*!< drop the frame */
+
 /* ----------------------------------------------------------------------- */
 /* stream management                                                       */
 
@@ -82,9 +105,55 @@ typedef struct {
 	/* video encoder only */
 	int scale;				/*!< how often shall the frame be down scaled before encoded */
 
-	/* internal: filled out by encoder/decoder automatically */
+	/* if encoding: the encoded formats to produce (0 for the defaults);
+	 * if decoding: filled out by the decoder automatically */
 	int encoded_video_fmt;
 	int encoded_cursor_fmt;
+
+	/* fields added since 0.3: append new fields at the end only, so the ones above
+	 * keep their offsets for binaries built against older headers */
+
+	/* video encoder only */
+	int keyframe_interval;	/*!< delta formats only: maximum distance between two keyframes
+								 (0 for the default) */
+
+	/* general (video) */
+	int threads;			/*!< number of threads used to (de)compress sliced formats
+								 (0 for one per online CPU) */
+
+	/* stream encoder only */
+	int async_frames;		/*!< if non-zero, frames are encoded and written in background threads,
+								 buffering up to this many frames */
+	int async_policy;		/*!< what to do when all async frame buffers are in use,
+								 either CAPSEO_ASYNC_BLOCK or CAPSEO_ASYNC_DROP */
+
+	/* stream decoder only */
+	int mmap_input;			/*!< if non-zero, the stream file is memory mapped and frames are
+								 decoded straight from the mapping (falls back to read() if
+								 the file cannot be mapped) */
+
+	/* stream encoder only */
+	int write_index;		/*!< if non-zero, a frame index is appended to the stream when
+								 destroying it, for fast seeking */
+
+	/* if encoding: the row order to store the frames in, bottom-up input frames being
+	 * flipped by the colour conversion if needed;
+	 * if decoding: filled out by the decoder automatically */
+	int orientation;		/*!< CAPSEO_ORIENTATION_BOTTOM_UP or CAPSEO_ORIENTATION_TOP_DOWN */
+
+	/* video encoder only */
+	int compression;		/*!< CAPSEO_COMPRESSION_* backend to compress the video frames
+								 and cursors with */
+	int compression_level;	/*!< backend specific level (QuickLZ: 1 fastest ... 3 smallest),
+								 or 0 for the backend's default */
+
+	/* stream decoder only */
+	int decode_ahead;		/*!< if non-zero, frames are read and decoded ahead in background threads,
+								 into a ring of this many frames, each kept until released by
+								 CapseoStreamReleaseFrame() */
+
+	/* if decoding: filled out by the decoder automatically */
+	int revision;			/*!< stream header revision (0 if unknown, e.g. when encoding) */
 } capseo_info_t;
 
 typedef struct {
@@ -99,6 +168,12 @@ typedef struct _capseo_frame_t {
 	uint8_t *buffer;					/*!< raw encoded/decoded buffer */
 } capseo_frame_t;
 
+typedef struct _capseo_stream_stats_t {
+	uint64_t submitted;					/*!< number of frames queued for encoding, not counting dropped ones */
+	uint64_t written;					/*!< number of frames written to the stream */
+	uint64_t dropped;					/*!< number of frames dropped due to CAPSEO_ASYNC_DROP */
+} capseo_stream_stats_t;
+
 typedef struct _capseo_cursor_t {
 	int32_t x;
 	int32_t y;
@@ -120,7 +195,13 @@ void CapseoStreamDestroy(capseo_stream_t *);
 
 capseo_frame_id_t CapseoStreamCreateFrameID(capseo_stream_t *);
 int CapseoStreamEncodeFrame(capseo_stream_t *cs, uint8_t *frame, capseo_frame_id_t id, capseo_cursor_t *cursor);
+int CapseoStreamEncodeFrameEx(capseo_stream_t *cs, const uint8_t *frame, int stride, int flags, capseo_frame_id_t id, capseo_cursor_t *cursor);
 int CapseoStreamDecodeFrame(capseo_stream_t *cs, capseo_frame_t **, int cursor);
+int CapseoStreamRetainFrame(capseo_stream_t *cs, capseo_frame_t *frame);
+void CapseoStreamReleaseFrame(capseo_stream_t *cs, capseo_frame_t *frame);
+int CapseoStreamGetStats(capseo_stream_t *cs, capseo_stream_stats_t *stats);
+int CapseoStreamSeek(capseo_stream_t *cs, capseo_frame_id_t id);
+int CapseoStreamGetDuration(capseo_stream_t *cs, capseo_frame_id_t *first, capseo_frame_id_t *last, uint64_t *frames);
 
 /* ------------------------------------------------------------------------ */
 
@@ -135,6 +216,9 @@ int CapseoInitialize(capseo_t *cs, capseo_info_t *info);
 
 capseo_frame_id_t CapseoCreateFrameID(capseo_t *cs);
 int CapseoEncodeFrame(capseo_t *cs, uint8_t *frame_in, capseo_frame_id_t id, capseo_cursor_t *cursor, uint8_t **outbuf, int *outlen);
+int CapseoEncodeFrameEx(capseo_t *cs, const uint8_t *frame_in, int stride, int flags, capseo_frame_id_t id, capseo_cursor_t *cursor, uint8_t **outbuf, int *outlen);
+int CapseoEncodeFrameBound(capseo_t *cs, capseo_cursor_t *cursor);
+int CapseoEncodeFrameInto(capseo_t *cs, const uint8_t *frame_in, int stride, int flags, capseo_frame_id_t id, capseo_cursor_t *cursor, uint8_t *outbuf, int outsize, int *outlen);
 
 int CapseoDecodeFrame(capseo_t *cs, uint8_t *inbuf, int inlen, int cursor, capseo_frame_t *out);
 
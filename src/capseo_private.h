@@ -16,26 +16,56 @@
 
 #include "capseo.h"
 
-#define CAPSEO_REVISION (1)
-
 #define CAPSEO_PACKED __attribute__((packed))
 
+struct TCapseoAsyncEncoder;
+struct TCapseoDecodeAhead;
+struct TCapseoIndexEntry;
+struct TCursorShape;
+
 struct _capseo_stream_t {
 	capseo_t frameHandle;
 	capseo_frame_t frames[2];			/*!< currently only used for decoding */
 
 	uint8_t *encodedHeader;				/*!< encoded header (frame/stream) */
 	uint8_t *encodedBuffer;				/*!< encoded frame buffer */
+	uint32_t encodedBufferLength;
 
 	uint64_t processedFrames;			/*!< number of already encoded/decoded frames */
 
 	int fd;								/*!< the actual file descriptor to read from/write to */
 	int autoCloseFd;					/*!< if true, the file descriptor will be cllosed 
 											 automatically on stream close */
+
+	struct TCapseoAsyncEncoder *async;	/*!< asynchronous encoder, if enabled */
+	struct TCapseoDecodeAhead *ahead;	/*!< decode-ahead frame ring, if enabled (decoder only) */
+
+	uint64_t streamBase;				/*!< file offset of the stream header */
+	uint64_t headerLength;				/*!< length of the stream header, i.e. offset of the first frame */
+	uint64_t streamOffset;				/*!< offset of the next frame, relative to streamBase */
+
+	struct TCapseoIndexEntry *index;	/*!< frame index (written by encoder or loaded on demand by decoder) */
+	uint64_t indexCount;
+	uint64_t indexCapacity;
+	int indexLoaded;					/*!< decoder only: whether the index has been loaded (or rebuilt) */
+
+	uint8_t *map;						/*!< memory mapped stream file, if enabled (decoder only) */
+	size_t mapLength;					/*!< length of the mapping */
+	size_t mapOffset;					/*!< offset of the next frame within the mapping */
+	size_t mapAdvised;					/*!< offset up to which readahead has been requested */
 };
 
 struct capseo_private_t {
 	uint8_t *yuvBuffer;					/*!< yuv buffer, in case we have to convert */
+	uint8_t *deltaBuffer;				/*!< delta formats: frame difference (or changed tiles) */
+	uint8_t *referenceBuffer;			/*!< delta formats and decoders: previous yuv frame */
+	uint8_t *filterBuffer;				/*!< filtered formats: row filters, followed by the filtered frame */
+	uint8_t *scaleBuffer;				/*!< downscaling encoders: scratch rows of the intermediate scale levels */
+
+	unsigned framesSinceKeyframe;		/*!< delta formats: frames encoded since last keyframe */
+
+	uint64_t frameHash;					/*!< hash of the previous frame's video, to spot repeated frames (encoder only) */
+	int frameHashed;					/*!< whether frameHash has been computed yet (encoder only) */
 
 	uint8_t *encodedBuffer;				/*!< encoded result buffer (frame) */
 	unsigned encodedBufferLength;		/*!< length of the result encoded buffer */
@@ -44,8 +74,17 @@ struct capseo_private_t {
 
 	// cursor related
 	capseo_cursor_t FCursor;
+	struct TCursorShape *cursorShapes;	/*!< shape cache slots (decoder, or cached cursor formats) */
+	int cursorSlot;						/*!< slot of the current shape, or -1 */
+	uint64_t cursorRecords;				/*!< cached cursor formats: cursor records encoded so far (encoder only) */
 
 	void *compressor;
+
+	// sliced formats only
+	void *workers;						/*!< worker thread pool */
+	int sliceCount;						/*!< number of slices to split a frame into when encoding */
+	void **sliceCompressors;			/*!< per-slice (de)compressor */
+	int sliceCompressorCount;
 };
 
 struct CAPSEO_PACKED TCapseoStreamHeader {
@@ -57,15 +96,36 @@ struct CAPSEO_PACKED TCapseoStreamHeader {
 
 	uint32_t fps;				//!< ideal recording fps, this is a hint value
 
-	uint32_t video_format;		//!< video frame format
+	uint32_t video_format;		//!< video frame format, see CAPSEO_STREAM_FORMAT()
 	uint32_t cursor_format;		//!< cursor format, or 0 if no cursor
+
+	uint32_t orientation;		//!< row order of the stored frames (since revision 2)
 };
 
+/*! encoded format id of the stream header, carrying the compression backend and its level in the upper 16 bits */
+#define CAPSEO_STREAM_FORMAT(AFormat, ACompression, ALevel)	((AFormat) | ((ACompression) << 16) | ((ALevel) << 24))
+
+/*! current stream header revision (revision 3 streams may contain repeated frames) */
+#define CAPSEO_STREAM_REVISION	(0x03)
+
+/*! whether frames of a stream of the given header revision (0 if unknown) may repeat their predecessor */
+static inline int repeatsFrames(int ARevision) {
+	return !ARevision || ARevision >= 0x03;
+}
+
+/*! length of a revision 1 stream header, which lacks the orientation */
+#define CAPSEO_STREAM_HEADER_V1_LENGTH	(sizeof(struct TCapseoStreamHeader) - sizeof(uint32_t))
+
+/*! length of the stream header of the given revision */
+static inline int streamHeaderLength(int ARevision) {
+	return ARevision >= 0x02 ? sizeof(struct TCapseoStreamHeader) : CAPSEO_STREAM_HEADER_V1_LENGTH;
+}
+
 struct CAPSEO_PACKED TCapseoFrameHeader {
 	capseo_frame_id_t id;	//!< frame ID
 
 	struct {
-		int32_t length;		//!< encoded video frame length
+		int32_t length;		//!< encoded video frame length, or 0 if the frame repeats the previous one's video
 	} video;
 
 	struct {
@@ -77,6 +137,125 @@ struct CAPSEO_PACKED TCapseoFrameHeader {
 	} cursor;
 };
 
+/*! length value of the frame record terminating the frame sequence, in case it is followed by an index */
+#define CAPSEO_INDEX_SENTINEL	(0xFFFFFFFF)
+
+/*! frame index entry.
+ *
+ *  An indexed stream ends with a CAPSEO_INDEX_SENTINEL frame length, followed by
+ *  one index entry per frame and the TCapseoIndexTrailer.
+ */
+struct CAPSEO_PACKED TCapseoIndexEntry {
+	capseo_frame_id_t id;		//!< frame ID
+	uint64_t offset;			//!< offset of the frame record (its length), relative to the stream header
+	uint8_t flags;				//!< CAPSEO_INDEX_* bits
+};
+
+#define CAPSEO_INDEX_KEYFRAME		(0x01)
+#define CAPSEO_INDEX_CURSOR			(0x02)	/*!< frame carries a cursor shape (or any cursor record, for cached cursor formats) */
+#define CAPSEO_INDEX_CURSOR_SHAPE	(0x04)	/*!< frame carries a new cursor shape, cached in the slot of the upper 4 bits */
+
+/*! cache slot of the cursor shape of an index entry with CAPSEO_INDEX_CURSOR_SHAPE set */
+#define CAPSEO_INDEX_CURSOR_SLOT(AFlags)	((AFlags) >> 4)
+
+struct CAPSEO_PACKED TCapseoIndexTrailer {
+	uint64_t offset;			//!< offset of the sentinel, relative to the stream header
+	uint64_t count;				//!< number of index entries
+	uint8_t magic[4];			//!< {'C', 'P', 'S', 'I'}
+};
+
+/* video frame types, as found in TCapseoVideoHeader::type */
+#define CAPSEO_FRAME_KEY		(0x01)	/*!< frame is decodable on its own */
+#define CAPSEO_FRAME_DELTA		(0x02)	/*!< frame depends on its previous frame */
+
+/*! video payload prefix of delta and tiled formats, followed by the compressed frame data
+ *  (or the tile bitmap and changed tiles, in case of a tiled delta frame).
+ */
+struct CAPSEO_PACKED TCapseoVideoHeader {
+	uint8_t type;			//!< CAPSEO_FRAME_KEY or CAPSEO_FRAME_DELTA
+};
+
+/*! slice table entry of sliced formats.
+ *
+ *  The video payload of a sliced frame consists of a TCapseoVideoHeader,
+ *  the number of slices (one byte), the slice table and the compressed slices.
+ */
+struct CAPSEO_PACKED TCapseoSliceHeader {
+	uint32_t rawLength;		//!< decoded slice length
+	uint32_t length;		//!< encoded slice length
+};
+
+/* cursor record types of cached cursor formats, as found in TCapseoCursorHeader::type */
+#define CAPSEO_CURSOR_MOVE		(0x01)	/*!< cursor moved, keeping its shape */
+#define CAPSEO_CURSOR_CACHED	(0x02)	/*!< cursor changed to a shape cached before */
+#define CAPSEO_CURSOR_SHAPE		(0x03)	/*!< cursor changed to a new shape, to be cached */
+
+/*! number of cursor shapes cached by encoder and decoder */
+#define CAPSEO_CURSOR_SLOTS		(16)
+
+/*! cursor payload prefix of CAPSEO_FORMAT_ENCORE_QLZCARGB, followed by the compressed
+ *  ARGB shape in case of a CAPSEO_CURSOR_SHAPE record.
+ *
+ *  Position and extent of the cursor are still found in the frame header. Frames
+ *  without cursor payload show the cursor unchanged.
+ */
+struct CAPSEO_PACKED TCapseoCursorHeader {
+	uint8_t type;			//!< CAPSEO_CURSOR_MOVE, CAPSEO_CURSOR_CACHED or CAPSEO_CURSOR_SHAPE
+	uint8_t slot;			//!< cache slot of the shape (also given for moves, to be decodable after seeking)
+};
+
+/*! a plane of a cursor sprite */
+struct TCursorPlane {
+	int width;
+	int height;
+	uint8_t *premultiplied;	//!< component of each pixel (or 2x2 block), premultiplied by its alpha
+	uint8_t *transparency;	//!< 255 - alpha of each pixel (or of the mean alpha of each 2x2 block)
+};
+
+/*! a cursor shape, downscaled and converted for blending it into YUV 4:2:0 frames.
+ *
+ *  The rows of all planes are stored in the row order of the frames. As the chroma
+ *  planes depend on how the sprite lines up with the frame's 2x2 blocks, they are
+ *  prepared for each parity of the sprite's position (x & 1 | (y & 1) << 1).
+ */
+struct TCursorSprite {
+	struct TCursorPlane luma;
+	struct TCursorPlane chroma[4][2];	//!< U and V plane, by position parity
+	uint8_t *storage;
+	int capacity;			//!< allocated length of storage
+};
+
+/*! a cursor shape of the shape cache */
+struct TCursorShape {
+	uint64_t hash;			//!< content hash (encoder only)
+	uint64_t lastUse;		//!< cursor record last referring to it, for eviction (encoder only)
+	int width;				//!< width, or 0 if the slot is unused
+	int height;
+	uint8_t *image;			//!< ARGB image (encoder only)
+	int capacity;			//!< allocated length of image
+	struct TCursorSprite sprite;	//!< the shape as drawn (decoder only)
+};
+
+#define CAPSEO_PREDICT_LEFT		(0x00)	/*!< pixels are predicted by their left neighbour */
+#define CAPSEO_PREDICT_MEDIAN	(0x01)	/*!< pixels are predicted by the median of left, top and gradient */
+
+#define CAPSEO_FILTER_NONE		(0x00)	/*!< row is stored as is */
+#define CAPSEO_FILTER_LEFT		(0x01)	/*!< bytes are predicted by their left neighbour */
+#define CAPSEO_FILTER_UP		(0x02)	/*!< bytes are predicted by their upper neighbour */
+#define CAPSEO_FILTER_AVERAGE	(0x03)	/*!< bytes are predicted by the (rounded down) mean of left and upper neighbour */
+#define CAPSEO_FILTER_PAETH		(0x04)	/*!< bytes are predicted by the Paeth predictor of left, upper and upper left neighbour */
+
+/*! plane header of the HuffYUV format.
+ *
+ *  The video payload of a HuffYUV frame consists of the Y, U and V planes,
+ *  each as this header followed by its Huffman coded prediction residuals.
+ */
+struct CAPSEO_PACKED TCapseoHuffPlaneHeader {
+	uint8_t predictor;		//!< CAPSEO_PREDICT_LEFT or CAPSEO_PREDICT_MEDIAN
+	uint8_t lengths[128];	//!< code length of each residual (0 if unused), two nibbles per byte, low one first
+	uint32_t length;		//!< length of the coded residuals
+};
+
 typedef struct {
 	uint8_t y;
 	uint8_t u;
@@ -90,15 +269,108 @@ typedef struct {
 	uint8_t alpha;
 } rgba_pixel_t;
 
+/*! byte offsets of the colour components within a 32 bit RGB pixel */
+struct TPixelLayout {
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+	uint8_t a;
+};
+
+/*! encoded video frame width, i.e. after downscaling */
+static inline int videoWidth(const capseo_t *cs) {
+	return cs->info.mode == CAPSEO_MODE_ENCODE ? cs->info.width >> cs->info.scale : cs->info.width;
+}
+
+/*! encoded video frame height, i.e. after downscaling */
+static inline int videoHeight(const capseo_t *cs) {
+	return cs->info.mode == CAPSEO_MODE_ENCODE ? cs->info.height >> cs->info.scale : cs->info.height;
+}
+
+/*! maximum number of times convertBGRAtoYUV420Scaled() halves the frame dimensions */
+#define MAX_SCALE_LEVELS 16
+
+/*! length of the scratch space convertBGRAtoYUV420Scaled() needs to downscale rows of \p width pixels:
+ *  two rows per scale level, padded by a pixel pair as odd widths read beyond the row end */
+static inline uint32_t scaleScratchLength(uint32_t width, int scale) {
+	uint32_t length = 0;
+	for (int i = 1; i <= scale && i <= MAX_SCALE_LEVELS; ++i)
+		length += 2 * ((width >> i) + 2) * 4;
+
+	return length;
+}
+
+/*! first row of the pair of rows starting at row \p y, out of \p height rows, to colour convert together:
+ *  an odd last row is converted along with the row before it (overlapping the previous pair),
+ *  so no row or chroma row beyond the frame is touched */
+static inline uint32_t pairRow(uint32_t y, uint32_t height) {
+	return y + 1 < height ? y : y - 1;
+}
+
+/*! the given plane (0 = Y, 1 = U, 2 = V) of a \p width x \p height YUV 4:2:0 frame buffer,
+ *  the chroma planes starting at \p width * \p height and \p width * \p height * 5/4 even for odd sizes */
+static inline uint8_t *planeOf(uint8_t *yuv, int width, int height, int plane) {
+	switch (plane) {
+		case 1: return yuv + width * height;
+		case 2: return yuv + width * height * 5 / 4;
+		default: return yuv;
+	}
+}
+
+/*! whether raw input frames passed with \p AFlags need to be flipped vertically to match the stream's orientation */
+static inline int flipsInput(const capseo_info_t *AInfo, int AFlags) {
+	return (AFlags & CAPSEO_INPUT_BOTTOM_UP) && AInfo->orientation == CAPSEO_ORIENTATION_TOP_DOWN;
+}
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
 void convertBGRAtoYUV420(uint8_t *yuv[3], uint8_t *source, uint32_t width, uint32_t height);
 void scaleBGRA(unsigned char *buffer, uint32_t width, uint32_t height);
+void convertBGRAtoYUV420Scaled(uint8_t *yuv[3], const uint8_t *source, int32_t stride, uint32_t width, uint32_t height, int scale, uint8_t *scratch);
+void convertYUV420toRGB(uint8_t *rgb, uint8_t *yuv[3], uint32_t width, uint32_t height, const struct TPixelLayout *layout);
 uint8_t *encode(uint8_t *dst, uint8_t *src, uint32_t size);
 uint8_t *decode(uint8_t *dst, const uint8_t *src, uint32_t size);
-void drawCursor(capseo_t *cs, capseo_frame_t *out, capseo_cursor_t *cursor, int AResuseHint);
+void prepareCursorSprite(capseo_t *cs, struct TCursorSprite *sprite, capseo_cursor_t *cursor);
+void drawCursor(capseo_t *cs, capseo_frame_t *out, const capseo_cursor_t *cursor, const struct TCursorSprite *sprite);
+void initializeCursorCache(capseo_t *cs);
+void finalizeCursorCache(capseo_t *cs);
+int encodeCachedCursor(capseo_t *cs, capseo_cursor_t *cursor, uint8_t *outbuf);
+int decodeCachedCursor(capseo_t *cs, uint8_t *inbuf, int inlen, capseo_cursor_t *cursor);
+int deltaFrameBound(capseo_t *cs);
+int tileFrameBound(capseo_t *cs);
+int encodeDeltaFrame(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf);
+int decodeDeltaFrame(capseo_t *cs, uint8_t *inbuf, uint8_t *yuv);
+int encodeTileFrame(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf);
+int decodeTileFrame(capseo_t *cs, uint8_t *inbuf, int inlen, uint8_t *yuv);
+void initializeSlices(capseo_t *cs);
+void finalizeSlices(capseo_t *cs);
+int sliceFrameBound(capseo_t *cs);
+int encodeSliceFrame(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf);
+int decodeSliceFrame(capseo_t *cs, uint8_t *inbuf, int inlen, uint8_t *yuv);
+int huffyuvFrameBound(capseo_t *cs);
+int encodeHuffYUVFrame(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf);
+int decodeHuffYUVFrame(capseo_t *cs, uint8_t *inbuf, int inlen, uint8_t *yuv);
+int filteredFrameBound(capseo_t *cs);
+int encodeFilteredFrame(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf);
+int decodeFilteredFrame(capseo_t *cs, uint8_t *inbuf, uint8_t *yuv);
+int writeStreamFrame(capseo_stream_t *stream, uint8_t *encodedFrame, int length);
+int readStreamFrame(capseo_stream_t *stream, uint8_t **buffer, uint32_t *bufferLength, uint8_t **encodedFrame, uint32_t *length);
+int decodeStreamFrame(capseo_stream_t *stream, capseo_frame_t **frame, int cursor);
+void appendStreamIndex(capseo_stream_t *stream, const uint8_t *encodedFrame);
+int writeStreamIndex(capseo_stream_t *stream);
+void destroyStreamIndex(capseo_stream_t *stream);
+int createAsyncEncoder(capseo_stream_t *stream, int ASlots);
+void destroyAsyncEncoder(capseo_stream_t *stream);
+int submitAsyncFrame(capseo_stream_t *stream, const uint8_t *frame, int stride, int flags, capseo_frame_id_t id, capseo_cursor_t *cursor);
+void getAsyncStats(capseo_stream_t *stream, capseo_stream_stats_t *stats);
+int createDecodeAhead(capseo_stream_t *stream, int AFrames);
+void destroyDecodeAhead(capseo_stream_t *stream);
+void stopDecodeAhead(capseo_stream_t *stream);
+int takeAheadFrame(capseo_stream_t *stream, capseo_frame_t **frame, int cursor);
+int retainAheadFrame(capseo_stream_t *stream, capseo_frame_t *frame);
+void releaseAheadFrame(capseo_stream_t *stream, capseo_frame_t *frame);
 
 #if defined(__cplusplus)
 }
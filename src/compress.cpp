@@ -0,0 +1,167 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (compression backend registry)
+//
+//  Authors:
+//      Copyright (c) 2007-2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo.h"
+#include "compress.h"
+
+#include <string.h>
+#include <stdint.h>
+
+// {{{ stored backend: the block's length, followed by the input as is
+static int storeBound(int AInputSize) {
+	return sizeof(uint32_t) + AInputSize;
+}
+
+static void *storeCreate() {
+	return 0;
+}
+
+static int storeCompress(void * /*AState*/, const void *AInput, int AInputSize, void *AOutput) {
+	const uint32_t length = AInputSize;
+
+	memcpy(AOutput, &length, sizeof(length));
+	memcpy((uint8_t *)AOutput + sizeof(length), AInput, length);
+
+	return sizeof(length) + length;
+}
+
+static int storeDecompress(void * /*AState*/, const void *AInput, void *AOutput) {
+	uint32_t length;
+
+	memcpy(&length, AInput, sizeof(length));
+	memcpy(AOutput, (const uint8_t *)AInput + sizeof(length), length);
+
+	return length;
+}
+
+static int storeDecompressedSize(const void *AInput, int AInputSize) {
+	uint32_t length;
+
+	if (AInputSize < int(sizeof(length)))
+		return -1;
+
+	memcpy(&length, AInput, sizeof(length));
+
+	return length == uint32_t(AInputSize - sizeof(length)) ? int(length) : -1;
+}
+
+static void storeDestroy(void * /*AState*/) {
+}
+
+static const TCompressionBackend storeBackend = {
+	CAPSEO_COMPRESSION_NONE, 0, "none",
+	&storeBound,
+	&storeCreate, &storeCompress, &storeDestroy,
+	&storeCreate, &storeDecompress, &storeDecompressedSize, &storeDestroy
+};
+// }}}
+
+// (the first level registered for a backend is its default)
+static const TCompressionBackend *backends[] = {
+	&quicklz1Backend,
+	&quicklz2Backend,
+	&quicklz3Backend,
+	&lz4Backend,
+	&storeBackend,
+};
+
+/*! \brief retrieves the compression backend of the given CAPSEO_COMPRESSION_* id and level.
+ *  \param ALevel the compression level, or 0 for the backend's default. It is ignored
+ *                by backends without levels.
+ *  \return the backend, or 0 if there is none of that id and level
+ */
+const TCompressionBackend *findCompressionBackend(int AId, int ALevel) {
+	for (unsigned i = 0; i < sizeof(backends) / sizeof(*backends); ++i) {
+		const TCompressionBackend *backend = backends[i];
+
+		if (backend->id == AId && (!ALevel || !backend->level || backend->level == ALevel))
+			return backend;
+	}
+
+	return 0;
+}
+
+/*! (de)compressor handle */
+struct TCompressorHandle {
+	const TCompressionBackend *backend;
+	void *state;						//!< backend specific scratch
+};
+
+void *CompressorCreate(int ABackend, int ALevel) {
+	const TCompressionBackend *backend = findCompressionBackend(ABackend, ALevel);
+	if (!backend)
+		return 0;
+
+	TCompressorHandle *handle = new TCompressorHandle;
+	handle->backend = backend;
+	handle->state = backend->compressorCreate();
+
+	return handle;
+}
+
+/*! \brief returns the maximum number of bytes compressing \p AInputSize bytes may result into.
+ */
+int CompressBound(void *AHandle, int AInputSize) {
+	return ((TCompressorHandle *)AHandle)->backend->bound(AInputSize);
+}
+
+int Compress(void *AHandle, void *AInput, int AInputSize, void *AOutput) {
+	TCompressorHandle *handle = (TCompressorHandle *)AHandle;
+
+	return handle->backend->compress(handle->state, AInput, AInputSize, AOutput);
+}
+
+void CompressorDestroy(void *AHandle) {
+	TCompressorHandle *handle = (TCompressorHandle *)AHandle;
+	if (!handle)
+		return;
+
+	handle->backend->compressorDestroy(handle->state);
+	delete handle;
+}
+
+void *DecompressorCreate(int ABackend, int ALevel) {
+	const TCompressionBackend *backend = findCompressionBackend(ABackend, ALevel);
+	if (!backend)
+		return 0;
+
+	TCompressorHandle *handle = new TCompressorHandle;
+	handle->backend = backend;
+	handle->state = backend->decompressorCreate();
+
+	return handle;
+}
+
+int Decompress(void *AHandle, void *AInput, void *AOutput) {
+	TCompressorHandle *handle = (TCompressorHandle *)AHandle;
+
+	return handle->backend->decompress(handle->state, AInput, AOutput);
+}
+
+/*! \brief retrieves the decompressed size of the compressed block at \p AInput.
+ *  \return the decompressed size, or -1 if the block is not exactly \p AInputSize bytes long
+ */
+int DecompressedSize(void *AHandle, const void *AInput, int AInputSize) {
+	return ((TCompressorHandle *)AHandle)->backend->decompressedSize(AInput, AInputSize);
+}
+
+void DecompressorDestroy(void *AHandle) {
+	TCompressorHandle *handle = (TCompressorHandle *)AHandle;
+	if (!handle)
+		return;
+
+	handle->backend->decompressorDestroy(handle->state);
+	delete handle;
+}
+
+// vim:ai:noet:ts=4:nowrap
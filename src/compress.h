@@ -14,14 +14,48 @@
 #ifndef capseo_compress_h
 #define capseo_compress_h
 
-void *CompressorCreate();
+/*! \brief a compression backend, selected per stream by its CAPSEO_COMPRESSION_* id.
+ *
+ *  Each compressed block must describe its own (compressed and decompressed) length,
+ *  as decompress() is passed neither.
+ */
+struct TCompressionBackend {
+	int id;												//!< CAPSEO_COMPRESSION_* id, as recorded in the stream header
+	int level;											//!< compression level (also recorded), or 0 if the backend has none
+	const char *name;
+
+	int (*bound)(int AInputSize);						//!< maximum compressed size of \p AInputSize bytes
+
+	void *(*compressorCreate)();
+	int (*compress)(void *AState, const void *AInput, int AInputSize, void *AOutput);
+	void (*compressorDestroy)(void *AState);
+
+	void *(*decompressorCreate)();
+	int (*decompress)(void *AState, const void *AInput, void *AOutput);	//!< returns 0 on corrupt input
+	int (*decompressedSize)(const void *AInput, int AInputSize);		//!< -1 if the block is not \p AInputSize bytes long
+	void (*decompressorDestroy)(void *AState);
+};
+
+extern const TCompressionBackend quicklz1Backend;
+extern const TCompressionBackend quicklz2Backend;
+extern const TCompressionBackend quicklz3Backend;
+extern const TCompressionBackend lz4Backend;
+
+const TCompressionBackend *findCompressionBackend(int AId, int ALevel);
+
+// --------------------------------------------------------------------------
+// (the handles below are bound to the backend they have been created for)
+
+void *CompressorCreate(int ABackend, int ALevel);
+int CompressBound(void *AHandle, int AInputSize);
 int Compress(void *AHandle, void *AInput, int AInputSize, void *AOutput);
 void CompressorDestroy(void *AHandle);
 
 // --------------------------------------------------------------------------
 
-void *DecompressorCreate();
+void *DecompressorCreate(int ABackend, int ALevel);
 int Decompress(void *AHandle, void *AInput, void *AOutput);
+int DecompressedSize(void *AHandle, const void *AInput, int AInputSize);
 void DecompressorDestroy(void *AHandle);
 
 #endif
@@ -0,0 +1,242 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (LZ4 block format compression backend)
+//
+//  Authors:
+//      Copyright (c) 2007-2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo.h"
+#include "compress.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Each block consists of its header, followed by a single LZ4 block.
+ *
+ * An LZ4 block is a sequence of (token, literal length, literals, match offset,
+ * match length) records, the last one consisting of literals only. As required by
+ * the format, matches start at least MF_LIMIT bytes before the end of the input,
+ * and the last LAST_LITERALS bytes are literals.
+ */
+
+struct TLZ4BlockHeader {
+	uint32_t compressedLength;		//!< length of the block, including this header
+	uint32_t decompressedLength;
+};
+
+const int MIN_MATCH = 4;
+const int LAST_LITERALS = 5;
+const int MF_LIMIT = 12;
+const int MAX_OFFSET = 65535;
+const int HASH_LOG = 12;			//!< log2 of the number of hash table entries
+
+static inline uint32_t read32(const uint8_t *p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32_t hash(uint32_t AValue) {
+	return (AValue * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static inline uint8_t *writeLength(uint8_t *op, int ALength) {
+	for (; ALength >= 255; ALength -= 255)
+		*op++ = 255;
+
+	*op++ = uint8_t(ALength);
+	return op;
+}
+
+static uint8_t *writeSequence(uint8_t *op, const uint8_t *ALiterals, int ALiteralLength, int AOffset, int AMatchLength) {
+	uint8_t *token = op++;
+
+	*token = uint8_t((ALiteralLength < 15 ? ALiteralLength : 15) << 4);
+	if (ALiteralLength >= 15)
+		op = writeLength(op, ALiteralLength - 15);
+
+	memcpy(op, ALiterals, ALiteralLength);
+	op += ALiteralLength;
+
+	if (!AMatchLength) // last sequence
+		return op;
+
+	*op++ = uint8_t(AOffset);
+	*op++ = uint8_t(AOffset >> 8);
+
+	const int length = AMatchLength - MIN_MATCH;
+	*token |= uint8_t(length < 15 ? length : 15);
+	if (length >= 15)
+		op = writeLength(op, length - 15);
+
+	return op;
+}
+
+static int lz4Bound(int AInputSize) {
+	return sizeof(TLZ4BlockHeader) + AInputSize + AInputSize / 255 + 16;
+}
+
+static void *lz4CompressorCreate() {
+	// (stale entries are harmless, as every candidate gets verified)
+	return calloc(1 << HASH_LOG, sizeof(uint32_t));
+}
+
+static int lz4Compress(void *AState, const void *AInput, int AInputSize, void *AOutput) {
+	uint32_t *table = (uint32_t *)AState;
+	const uint8_t *in = (const uint8_t *)AInput;
+	uint8_t *op = (uint8_t *)AOutput + sizeof(TLZ4BlockHeader);
+
+	int anchor = 0;
+	const int matchLimit = AInputSize - LAST_LITERALS;
+
+	for (int ip = 0; ip < AInputSize - MF_LIMIT; ) {
+		const uint32_t sequence = read32(in + ip);
+		const uint32_t h = hash(sequence);
+		int candidate = table[h];
+		table[h] = ip;
+
+		if (candidate >= ip || ip - candidate > MAX_OFFSET || read32(in + candidate) != sequence) {
+			// skip faster through incompressible data
+			ip += 1 + ((ip - anchor) >> 6);
+			continue;
+		}
+
+		int start = ip;
+		while (start > anchor && candidate > 0 && in[start - 1] == in[candidate - 1]) {
+			--start;
+			--candidate;
+		}
+
+		int length = ip - start + MIN_MATCH;
+		while (start + length < matchLimit && in[candidate + length] == in[start + length])
+			++length;
+
+		op = writeSequence(op, in + anchor, start - anchor, start - candidate, length);
+
+		ip = anchor = start + length;
+	}
+
+	op = writeSequence(op, in + anchor, AInputSize - anchor, 0, 0);
+
+	TLZ4BlockHeader header;
+	header.compressedLength = op - (uint8_t *)AOutput;
+	header.decompressedLength = AInputSize;
+	memcpy(AOutput, &header, sizeof(header));
+
+	return header.compressedLength;
+}
+
+static void *lz4DecompressorCreate() {
+	return 0;
+}
+
+/*! \brief reads the extension bytes of a literal or match length.
+ *  \retval false the input ended prematurely
+ */
+static inline bool readLength(const uint8_t *& ip, const uint8_t *end, uint32_t& ALength) {
+	for (;;) {
+		if (ip == end)
+			return false;
+
+		const uint8_t byte = *ip++;
+		ALength += byte;
+
+		if (byte != 255)
+			return true;
+	}
+}
+
+static int lz4Decompress(void * /*AState*/, const void *AInput, void *AOutput) {
+	TLZ4BlockHeader header;
+	memcpy(&header, AInput, sizeof(header));
+
+	if (header.compressedLength <= sizeof(header))
+		return 0;
+
+	const uint8_t *ip = (const uint8_t *)AInput + sizeof(header);
+	const uint8_t *inEnd = (const uint8_t *)AInput + header.compressedLength;
+	uint8_t *out = (uint8_t *)AOutput;
+	uint8_t *op = out;
+	uint8_t *outEnd = out + header.decompressedLength;
+
+	for (;;) {
+		const uint8_t token = *ip++;
+
+		uint32_t length = token >> 4;
+		if (length == 15 && !readLength(ip, inEnd, length))
+			return 0;
+
+		if (length > uint32_t(inEnd - ip) || length > uint32_t(outEnd - op))
+			return 0;
+
+		memcpy(op, ip, length);
+		ip += length;
+		op += length;
+
+		if (ip == inEnd) // (the last sequence has no match)
+			break;
+
+		if (inEnd - ip < 2)
+			return 0;
+
+		const uint32_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if (!offset || offset > uint32_t(op - out))
+			return 0;
+
+		length = token & 15;
+		if (length == 15 && !readLength(ip, inEnd, length))
+			return 0;
+
+		length += MIN_MATCH;
+		if (length > uint32_t(outEnd - op))
+			return 0;
+
+		// (matches may overlap their own output)
+		const uint8_t *match = op - offset;
+		if (offset >= length) {
+			memcpy(op, match, length);
+			op += length;
+		} else {
+			for (uint32_t i = 0; i < length; ++i)
+				*op++ = *match++;
+		}
+
+		if (ip == inEnd)
+			return 0;
+	}
+
+	return op == outEnd ? header.decompressedLength : 0;
+}
+
+static int lz4DecompressedSize(const void *AInput, int AInputSize) {
+	TLZ4BlockHeader header;
+
+	if (AInputSize < int(sizeof(header)))
+		return -1;
+
+	memcpy(&header, AInput, sizeof(header));
+
+	return header.compressedLength == uint32_t(AInputSize) ? int(header.decompressedLength) : -1;
+}
+
+static void lz4Destroy(void *AState) {
+	free(AState);
+}
+
+const TCompressionBackend lz4Backend = {
+	CAPSEO_COMPRESSION_LZ4, 0, "lz4",
+	&lz4Bound,
+	&lz4CompressorCreate, &lz4Compress, &lz4Destroy,
+	&lz4DecompressorCreate, &lz4Decompress, &lz4DecompressedSize, &lz4Destroy
+};
+
+// vim:ai:noet:ts=4:nowrap
@@ -11,41 +11,70 @@
 //  the terms of GPL. See the file COPYING.
 //
 /////////////////////////////////////////////////////////////////////////////
+#include "capseo.h"
 #include "compress.h"
 
-extern "C" {
-	#include "quicklz.h"
-}
-
 #include <string.h>
 #include <stdlib.h>
 
-void *CompressorCreate() {
-	char *scratch = (char *)malloc(QLZ_SCRATCH_COMPRESS);
-	memset(scratch, 0, QLZ_SCRATCH_COMPRESS);
-
-	return scratch;
+/*! \brief returns the maximum number of bytes compressing \p AInputSize bytes may result into.
+ */
+static int quicklzBound(int AInputSize) {
+	return AInputSize + 400;
 }
 
-int Compress(void *AHandle, void *AInput, int AInputSize, void *AOutput) {
-	return qlz_compress((const char *)AInput, (char *)AOutput, AInputSize, (char *)AHandle);
+/*! \brief returns the length of the header of the QuickLZ block starting with the given flags byte.
+ */
+static inline int quicklzHeaderLength(char AFlags) {
+	return AFlags & 2 ? 9 : 3;
 }
 
-void CompressorDestroy(void *AHandle) {
-	free(AHandle);
-}
+/*! defines the backend of the QuickLZ variant of the given level (see quicklz_variant.h),
+ *  its scratch buffers being sized for that level */
+#define QUICKLZ_BACKEND(level)																	\
+	extern "C" {																				\
+		size_t qlz##level##_compress(const void *source, char *destination, size_t size, char *scratch_compress);	\
+		size_t qlz##level##_decompress(const char *source, void *destination, char *scratch_decompress);		\
+		size_t qlz##level##_size_decompressed(const char *source);								\
+		size_t qlz##level##_size_compressed(const char *source);								\
+		extern const size_t qlz##level##_scratch_compress;										\
+		extern const size_t qlz##level##_scratch_decompress;									\
+	}																							\
+																								\
+	static void *quicklz##level##CompressorCreate() {											\
+		return calloc(1, qlz##level##_scratch_compress);										\
+	}																							\
+																								\
+	static int quicklz##level##Compress(void *AState, const void *AInput, int AInputSize, void *AOutput) {	\
+		return qlz##level##_compress(AInput, (char *)AOutput, AInputSize, (char *)AState);		\
+	}																							\
+																								\
+	static void *quicklz##level##DecompressorCreate() {										\
+		return calloc(1, qlz##level##_scratch_decompress);										\
+	}																							\
+																								\
+	static int quicklz##level##Decompress(void *AState, const void *AInput, void *AOutput) {	\
+		return qlz##level##_decompress((const char *)AInput, AOutput, (char *)AState);			\
+	}																							\
+																								\
+	static int quicklz##level##DecompressedSize(const void *AInput, int AInputSize) {			\
+		const char *source = (const char *)AInput;												\
+		if (AInputSize < 1 || AInputSize < quicklzHeaderLength(*source)							\
+			|| qlz##level##_size_compressed(source) != size_t(AInputSize))						\
+			return -1;																			\
+		return qlz##level##_size_decompressed(source);											\
+	}																							\
+																								\
+	const TCompressionBackend quicklz##level##Backend = {										\
+		CAPSEO_COMPRESSION_QUICKLZ, level, "quicklz",											\
+		&quicklzBound,																			\
+		&quicklz##level##CompressorCreate, &quicklz##level##Compress, &free,					\
+		&quicklz##level##DecompressorCreate, &quicklz##level##Decompress,						\
+		&quicklz##level##DecompressedSize, &free												\
+	};
 
-void *DecompressorCreate() {
-	char *scratch = (char *)malloc(QLZ_SCRATCH_DECOMPRESS);
-	memset(scratch, 0, QLZ_SCRATCH_DECOMPRESS);
+QUICKLZ_BACKEND(1)
+QUICKLZ_BACKEND(2)
+QUICKLZ_BACKEND(3)
 
-	return scratch;
-}
-
-int Decompress(void *AHandle, void *AInput, void *AOutput) {
-	return qlz_decompress((const char *)AInput, (char *)AOutput, (char *)AHandle);
-}
-
-void DecompressorDestroy(void *AHandle) {
-	free(AHandle);
-}
+// vim:ai:noet:ts=4:nowrap
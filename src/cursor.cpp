@@ -13,9 +13,9 @@
 /////////////////////////////////////////////////////////////////////////////
 #include "capseo.h"
 #include "capseo_private.h"
+#include "blend.h"
 
 #include <stdio.h>
-#include <math.h>
 #include <assert.h>
 
 // {{{ yuv-helper
@@ -93,78 +93,179 @@ static inline void scaleARGB(unsigned char *buffer, uint32_t width, uint32_t hei
 	#undef C
 }
 
-/*! \brief draws the cursor into the frame
- *  \param cs decoder handle
- *  \param out frame to draw the cursor onto
- *  \param cursor the cursor to be drawn 
- *  \param AReuseHint this is a cursor we've already drawn last frame
- *  \remarks currently <b>only</b> ARGB cursors as input are supported - as provided by XFixes X11 extension.
- *  \todo need downscaling of the cursor shape and recomputation of (x,y) 
- *  	  when video has been scaled at encoding time.
+/*! \brief (re)allocates the planes of a \p AWidth x \p AHeight sprite.
  */
-void drawCursor(capseo_t *cs, capseo_frame_t *out, capseo_cursor_t *cursor, int AReuseHint) {
-	uint32_t *src = (uint32_t *)cursor->buffer;
+static void reserveSprite(TCursorSprite *sprite, int AWidth, int AHeight) {
+	const int lumaSize = AWidth * AHeight;
+	const int chromaSize = (AWidth / 2 + 1) * (AHeight / 2 + 1);
+	const int length = lumaSize * 2 + chromaSize * 3 * 4;
+
+	if (length > sprite->capacity) {
+		delete[] sprite->storage;
+		sprite->storage = new uint8_t[length];
+		sprite->capacity = length;
+	}
+
+	uint8_t *p = sprite->storage;
+
+	sprite->luma.width = AWidth;
+	sprite->luma.height = AHeight;
+	sprite->luma.premultiplied = p;
+	sprite->luma.transparency = p + lumaSize;
+	p += lumaSize * 2;
+
+	for (int phase = 0; phase < 4; ++phase, p += chromaSize * 3) {
+		TCursorPlane *u = &sprite->chroma[phase][0];
+		TCursorPlane *v = &sprite->chroma[phase][1];
 
-	const int cx = cursor->x / int(pow(2, cs->info.scale));
-	const int cy = cursor->y / int(pow(2, cs->info.scale));
+		u->width = v->width = (AWidth + (phase & 1) + 1) / 2;
+		u->height = v->height = (AHeight + (phase >> 1) + 1) / 2;
 
+		u->premultiplied = p;
+		v->premultiplied = p + chromaSize;
+		u->transparency = v->transparency = p + chromaSize * 2;
+	}
+}
+
+/*! \brief prepares the sprite of the given cursor shape for drawing it.
+ *  \param cs decoder handle
+ *  \param sprite the sprite to (re)build
+ *  \param cursor the cursor shape, as ARGB as provided by the XFixes X11 extension.
+ *                Its buffer is downscaled in place, in case the video has been scaled at encoding time.
+ *
+ *  Done once per shape, so that drawing it boils down to a multiply and add per byte.
+ */
+void prepareCursorSprite(capseo_t *cs, TCursorSprite *sprite, capseo_cursor_t *cursor) {
 	int cw = cursor->width;
 	int ch = cursor->height;
 
-	if (AReuseHint) {
-		cw /= int(pow(2, cs->info.scale));
-		ch /= int(pow(2, cs->info.scale));
-	} else
-		for (int i = cs->info.scale; i > 0; --i, cw /= 2, ch /= 2)
-			scaleARGB(cursor->buffer, cw, ch);
+	for (int i = cs->info.scale; i > 0; --i, cw /= 2, ch /= 2)
+		scaleARGB(cursor->buffer, cw, ch);
 
-	uint8_t *yuv[3];
-	yuv[0] = out->buffer;
-	yuv[1] = yuv[0] + cs->info.width * cs->info.height;
-	yuv[2] = yuv[1] + cs->info.width * cs->info.height / 4;
+	reserveSprite(sprite, cw, ch);
 
-	const int w2 = cs->info.width / 2;
+	// (cursor rows are top-down, bottom-up frames get them flipped)
+	const bool flip = cs->info.orientation != CAPSEO_ORIENTATION_TOP_DOWN;
+	const uint32_t *src = (const uint32_t *)cursor->buffer;
 
-	// {{{ debug: draw box
-#if 0
-	drawLineH(cs, out, cursor->y, cursor->x, cursor->width);
-	drawLineH(cs, out, cursor->y - cursor->height, cursor->x, cursor->width);
-	drawLineV(cs, out, cursor->x, cursor->y, cursor->height);
-	drawLineV(cs, out, cursor->x + cursor->width, cursor->y, cursor->height);
-#endif
-	// }}}
+	#define PIXEL(x, y) (src[(flip ? ch - 1 - (y) : (y)) * cw + (x)])
 
 	for (int y = 0; y < ch; ++y) {
 		for (int x = 0; x < cw; ++x) {
-			uint8_t a = (*src >> 24) & 0xFF;
+			const uint32_t pixel = PIXEL(x, y);
+			const unsigned a = (pixel >> 24) & 0xFF;
+			const unsigned r = (pixel >> 16) & 0xFF;
+			const unsigned g = (pixel >> 8) & 0xFF;
+			const unsigned b = pixel & 0xFF;
 
-			if (a) {
-				a = 255 - a; // invert so that it is true for: (alpha == 255) := invisible
+			sprite->luma.premultiplied[y * cw + x] = (Y_VALUE(r, g, b) * a + 127) / 255;
+			sprite->luma.transparency[y * cw + x] = 255 - a;
+		}
+	}
 
-				const int dx = cx + x;
-				const int dy = cy - y;
+	// each chroma sample covers a 2x2 block, pixels outside the sprite being transparent
+	for (int phase = 0; phase < 4; ++phase) {
+		TCursorPlane *u = &sprite->chroma[phase][0];
+		TCursorPlane *v = &sprite->chroma[phase][1];
+		const int px = phase & 1;
+		const int py = phase >> 1;
 
-				uint8_t r = ((*src >> 16) & 0xFF);
-				uint8_t g = ((*src >> 8) & 0xFF);
-				uint8_t b = ((*src) & 0xFF);
+		for (int y = 0; y < u->height; ++y) {
+			for (int x = 0; x < u->width; ++x) {
+				int alpha = 0, r = 0, g = 0, b = 0;
 
-				uint8_t *yp = &yuv[0][dy * cs->info.width + dx];
-				*yp = *yp * a / 255 + Y_VALUE(r, g, b) * (1 - a/255);
+				for (int sy = 2 * y - py; sy < 2 * y - py + 2; ++sy) {
+					for (int sx = 2 * x - px; sx < 2 * x - px + 2; ++sx) {
+						if (sx < 0 || sy < 0 || sx >= cw || sy >= ch)
+							continue;
 
-// look ugly :( FIXME
-#if 0
-				const int dsp = 0; // displacement
+						const uint32_t pixel = PIXEL(sx, sy);
+						const int a = (pixel >> 24) & 0xFF;
 
-				uint8_t *up = &yuv[1][w2*dy/2 + dx/2 + dsp];
-				*up = ((*up * 3) + U_VALUE(r, g, b)) / 4;
+						alpha += a;
+						r += a * int((pixel >> 16) & 0xFF);
+						g += a * int((pixel >> 8) & 0xFF);
+						b += a * int(pixel & 0xFF);
+					}
+				}
 
-				uint8_t *vp = &yuv[2][w2*dy/2 + dx/2 + dsp];
-				*vp = ((*vp * 3) + V_VALUE(r, g, b)) / 4;
-#endif
+				// (alpha weighted sums, i.e. premultiplied by 4 * 255 the mean alpha)
+				const int us = -m[1][ri] * r - m[1][gi] * g + m[1][bi] * b + (128 << SCALE) * alpha;
+				const int vs = +m[2][ri] * r - m[2][gi] * g - m[2][bi] * b + (128 << SCALE) * alpha;
+				const int divisor = (4 * 255) << SCALE;
+
+				u->premultiplied[y * u->width + x] = (us + divisor / 2) / divisor;
+				v->premultiplied[y * v->width + x] = (vs + divisor / 2) / divisor;
+				u->transparency[y * u->width + x] = 255 - (alpha + 2) / 4;
 			}
-			++src;
 		}
 	}
+
+	#undef PIXEL
+}
+
+/*! \brief blends the sprite plane over the given frame plane, with its top left pixel at (\p AX, \p AY).
+ */
+static void blendPlane(TBlendRow blendRow, uint8_t *APlane, int AWidth, int AHeight, const TCursorPlane *ASprite, int AX, int AY) {
+	// clip to the frame
+	const int x0 = AX > 0 ? AX : 0;
+	const int y0 = AY > 0 ? AY : 0;
+	const int x1 = AX + ASprite->width < AWidth ? AX + ASprite->width : AWidth;
+	const int y1 = AY + ASprite->height < AHeight ? AY + ASprite->height : AHeight;
+
+	if (x0 >= x1)
+		return;
+
+	for (int y = y0; y < y1; ++y) {
+		const int offset = (y - AY) * ASprite->width + (x0 - AX);
+
+		blendRow(APlane + y * AWidth + x0, ASprite->premultiplied + offset, ASprite->transparency + offset, x1 - x0);
+	}
+}
+
+/*! \brief draws the cursor into the frame
+ *  \param cs decoder handle
+ *  \param out frame to draw the cursor onto
+ *  \param cursor the cursor position (in the coordinates of the unscaled video)
+ *  \param sprite the cursor shape, as prepared by prepareCursorSprite()
+ *
+ *  The cursor is clipped to the frame, as it may hang over its edges.
+ */
+void drawCursor(capseo_t *cs, capseo_frame_t *out, const capseo_cursor_t *cursor, const TCursorSprite *sprite) {
+	const int width = cs->info.width;
+	const int height = cs->info.height;
+	TBlendRow blendRow = blendKernels()->blendRow;
+
+	uint8_t *yuv[3];
+	yuv[0] = out->buffer;
+	yuv[1] = yuv[0] + width * height;
+	yuv[2] = yuv[1] + width * height / 4;
+
+	// (cursor coordinates count rows bottom-up, whatever row order the frame is stored in)
+	const int cx = cursor->x / (1 << cs->info.scale);
+	const int cy = cursor->y / (1 << cs->info.scale);
+
+	// top left pixel of the sprite within the frame buffer
+	const int x = cx;
+	const int y = cs->info.orientation == CAPSEO_ORIENTATION_TOP_DOWN ? height - 1 - cy : cy - (sprite->luma.height - 1);
+
+	// {{{ debug: draw box
+#if 0
+	drawLineH(cs, out, cursor->y, cursor->x, cursor->width);
+	drawLineH(cs, out, cursor->y - cursor->height, cursor->x, cursor->width);
+	drawLineV(cs, out, cursor->x, cursor->y, cursor->height);
+	drawLineV(cs, out, cursor->x + cursor->width, cursor->y, cursor->height);
+#endif
+	// }}}
+
+	blendPlane(blendRow, yuv[0], width, height, &sprite->luma, x, y);
+
+	const int px = x & 1;
+	const int py = y & 1;
+	const TCursorPlane *chroma = sprite->chroma[px | py << 1];
+
+	for (int i = 0; i < 2; ++i)
+		blendPlane(blendRow, yuv[1 + i], width / 2, height / 2, &chroma[i], (x - px) / 2, (y - py) / 2);
 }
 
 // vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,192 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (cursor shape cache)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo.h"
+#include "capseo_private.h"
+#include "compress.h"
+
+#include <string.h>
+
+/* Desktops cycle through a handful of cursor shapes, so encoder and decoder
+ * keep the last CAPSEO_CURSOR_SLOTS shapes. The encoder looks each cursor up
+ * by its content hash and emits a new shape only if it isn't cached yet,
+ * naming the slot to evict (the least recently used one). The decoder just
+ * follows the slots named, so both caches never diverge, and keeps each shape
+ * as the sprite drawn.
+ */
+
+/*! \brief initializes the cursor shape cache of the given handle.
+ *
+ *  Decoders of other cursor formats keep the current shape in the first slot.
+ */
+void initializeCursorCache(capseo_t *cs) {
+	cs->priv->cursorShapes = new TCursorShape[CAPSEO_CURSOR_SLOTS];
+	bzero(cs->priv->cursorShapes, sizeof(TCursorShape) * CAPSEO_CURSOR_SLOTS);
+
+	cs->priv->cursorSlot = -1;
+}
+
+void finalizeCursorCache(capseo_t *cs) {
+	if (!cs->priv->cursorShapes)
+		return;
+
+	for (int i = 0; i < CAPSEO_CURSOR_SLOTS; ++i) {
+		delete[] cs->priv->cursorShapes[i].image;
+		delete[] cs->priv->cursorShapes[i].sprite.storage;
+	}
+
+	delete[] cs->priv->cursorShapes;
+	cs->priv->cursorShapes = 0;
+}
+
+/*! \brief (re)allocates the image of the given slot for a \p AWidth x \p AHeight shape.
+ */
+static void reserveShape(TCursorShape *AShape, int AWidth, int AHeight) {
+	const int length = AWidth * AHeight * 4;
+
+	if (length > AShape->capacity) {
+		delete[] AShape->image;
+		AShape->image = new uint8_t[length];
+		AShape->capacity = length;
+	}
+
+	AShape->width = AWidth;
+	AShape->height = AHeight;
+}
+
+/*! \brief computes the FNV-1a hash of the cursor's extent and pixels.
+ */
+static uint64_t shapeHash(const capseo_cursor_t *cursor) {
+	const uint64_t prime = 0x100000001b3ULL;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	hash = (hash ^ uint32_t(cursor->width)) * prime;
+	hash = (hash ^ uint32_t(cursor->height)) * prime;
+
+	const uint32_t *pixels = (const uint32_t *)cursor->buffer;
+	for (int i = 0, count = cursor->width * cursor->height; i < count; ++i)
+		hash = (hash ^ pixels[i]) * prime;
+
+	return hash;
+}
+
+/*! \brief encodes the cursor record of a cached cursor format.
+ *  \param cs the encoder handle
+ *  \param cursor the cursor to encode
+ *  \param outbuf the buffer to store the cursor payload into
+ *  \return the cursor payload length, or 0 if neither position nor shape changed
+ */
+int encodeCachedCursor(capseo_t *cs, capseo_cursor_t *cursor, uint8_t *outbuf) {
+	TCursorShape *shapes = cs->priv->cursorShapes;
+	capseo_cursor_t& last = cs->priv->FCursor;
+
+	const uint64_t hash = shapeHash(cursor);
+	const uint64_t use = ++cs->priv->cursorRecords;
+	const int length = cursor->width * cursor->height * 4;
+
+	// (unused slots are least recently used)
+	int slot = -1;
+	int victim = 0;
+	for (int i = 0; i < CAPSEO_CURSOR_SLOTS && slot == -1; ++i) {
+		const TCursorShape& shape = shapes[i];
+
+		// (the hash picks the candidate, the content decides)
+		if (shape.image && shape.hash == hash && shape.width == cursor->width && shape.height == cursor->height
+				&& !memcmp(shape.image, cursor->buffer, length))
+			slot = i;
+		else if (shape.lastUse < shapes[victim].lastUse)
+			victim = i;
+	}
+
+	TCapseoCursorHeader *header = (TCapseoCursorHeader *)outbuf;
+	int outlen = sizeof(TCapseoCursorHeader);
+
+	if (slot != -1 && slot == cs->priv->cursorSlot) {
+		if (cursor->x == last.x && cursor->y == last.y) {
+			shapes[slot].lastUse = use;
+			return 0;
+		}
+
+		header->type = CAPSEO_CURSOR_MOVE;
+	} else if (slot != -1) {
+		header->type = CAPSEO_CURSOR_CACHED;
+	} else {
+		slot = victim;
+
+		TCursorShape& shape = shapes[slot];
+		reserveShape(&shape, cursor->width, cursor->height);
+		memcpy(shape.image, cursor->buffer, length);
+		shape.hash = hash;
+
+		header->type = CAPSEO_CURSOR_SHAPE;
+		outlen += Compress(cs->priv->compressor, cursor->buffer, length, outbuf + outlen);
+	}
+
+	header->slot = slot;
+	shapes[slot].lastUse = use;
+
+	cs->priv->cursorSlot = slot;
+	last.x = cursor->x;
+	last.y = cursor->y;
+
+	return outlen;
+}
+
+/*! \brief decodes the cursor record of a cached cursor format.
+ *  \param cs the decoder handle
+ *  \param inbuf the cursor payload
+ *  \param inlen the cursor payload length
+ *  \param cursor the cursor, with position and extent taken from the frame header
+ *  \retval CAPSEO_SUCCESS success, the slot of the record is the current one
+ *  \retval CAPSEO_E_INVALID_HEADER corrupt cursor record, or one referring to an empty slot
+ *
+ *  New shapes are prepared for drawing right away, so the decoder caches sprites rather than images.
+ */
+int decodeCachedCursor(capseo_t *cs, uint8_t *inbuf, int inlen, capseo_cursor_t *cursor) {
+	const TCapseoCursorHeader *header = (const TCapseoCursorHeader *)inbuf;
+	const int length = cursor->width * cursor->height * 4;
+
+	if (inlen < int(sizeof(TCapseoCursorHeader)) || header->slot >= CAPSEO_CURSOR_SLOTS
+			|| cursor->width <= 0 || cursor->height <= 0 || length > int(cs->priv->encodedBufferLength))
+		return CAPSEO_E_INVALID_HEADER;
+
+	TCursorShape& shape = cs->priv->cursorShapes[header->slot];
+
+	switch (header->type) {
+		case CAPSEO_CURSOR_SHAPE:
+			cursor->buffer = cs->priv->encodedBuffer; // (as tmp storage)
+			if (Decompress(cs->priv->compressor, inbuf + sizeof(TCapseoCursorHeader), cursor->buffer) != length) {
+				shape.width = 0;
+				return CAPSEO_E_INVALID_HEADER;
+			}
+
+			shape.width = cursor->width;
+			shape.height = cursor->height;
+			prepareCursorSprite(cs, &shape.sprite, cursor);
+			break;
+		case CAPSEO_CURSOR_MOVE:
+		case CAPSEO_CURSOR_CACHED:
+			if (!shape.width || shape.width != cursor->width || shape.height != cursor->height
+					|| inlen != int(sizeof(TCapseoCursorHeader)))
+				return CAPSEO_E_INVALID_HEADER;
+			break;
+		default:
+			return CAPSEO_E_INVALID_HEADER;
+	}
+
+	cs->priv->cursorSlot = header->slot;
+
+	return CAPSEO_SUCCESS;
+}
+
+// vim:ai:noet:ts=4:nowrap
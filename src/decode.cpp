@@ -16,6 +16,7 @@
 #include "compress.h"
 
 #include <assert.h>
+#include <string.h>
 
 /*! \brief decodes a capseo stream header from the bitstream
  *  \param inbuf bitstream input packet
@@ -37,7 +38,7 @@
  *  \endcode
  */
 int CapseoDecodeStreamHeader(uint8_t *inbuf, int inlen, capseo_info_t *out) {
-	if (inlen != sizeof(TCapseoStreamHeader))
+	if (inlen < int(CAPSEO_STREAM_HEADER_V1_LENGTH))
 		return CAPSEO_E_INVALID_ARGUMENT;
 
 	TCapseoStreamHeader *header = (TCapseoStreamHeader *)inbuf;
@@ -46,18 +47,36 @@ int CapseoDecodeStreamHeader(uint8_t *inbuf, int inlen, capseo_info_t *out) {
 
 	// now we may be sure, that we're talking about a header that belongs to us
 
-	if (header->magic[3] != 0x01) // only codec revision 0 supported
+	const int revision = header->magic[3];
+	if (revision < 0x01 || revision > CAPSEO_STREAM_REVISION)
 		return CAPSEO_E_NOT_SUPPORTED;
 
+	if (inlen != streamHeaderLength(revision))
+		return CAPSEO_E_INVALID_ARGUMENT;
+
+	out->revision = revision;
 	out->width = ntohl(header->width);
 	out->height = ntohl(header->height);
 	out->scale = ntohl(header->scale);
 	out->fps = ntohl(header->fps);
 
-	out->encoded_video_fmt = ntohl(header->video_format);
-	out->encoded_cursor_fmt = ntohl(header->cursor_format);
+	const uint32_t videoFormat = ntohl(header->video_format);
+	const uint32_t cursorFormat = ntohl(header->cursor_format);
+
+	out->encoded_video_fmt = videoFormat & 0xFFFF;
+	out->encoded_cursor_fmt = cursorFormat & 0xFFFF;
+	out->compression = (videoFormat >> 16) & 0xFF;
+	out->compression_level = videoFormat >> 24; // (0 for streams recorded before levels were selectable)
+
+	// (video frames and cursors share their decompressor)
+	if (cursorFormat && (cursorFormat >> 16) != videoFormat >> 16)
+		return CAPSEO_E_NOT_SUPPORTED;
+
+	// (revision 1 streams were recorded bottom-up, as read by glReadPixels())
+	out->orientation = revision >= 0x02 ? ntohl(header->orientation) : CAPSEO_ORIENTATION_BOTTOM_UP;
 
 	switch (out->encoded_cursor_fmt) {
+		case CAPSEO_FORMAT_ENCORE_QLZCARGB:
 		case CAPSEO_FORMAT_ENCORE_QLZARGB:
 		case CAPSEO_FORMAT_ENCORE_ARGB:
 			out->cursor_format = CAPSEO_FORMAT_ARGB;
@@ -67,6 +86,33 @@ int CapseoDecodeStreamHeader(uint8_t *inbuf, int inlen, capseo_info_t *out) {
 	return CAPSEO_SUCCESS;
 }
 
+/*! \brief retrieves the byte offsets of the colour components of the given RGB format.
+ *  \retval false \p AFormat is no 32 bit RGB format
+ */
+static bool pixelLayoutOf(int AFormat, TPixelLayout *ALayout) {
+	static const TPixelLayout bgra = { 2, 1, 0, 3 };
+	static const TPixelLayout rgba = { 0, 1, 2, 3 };
+	static const TPixelLayout argb = { 1, 2, 3, 0 };
+	static const TPixelLayout abgr = { 3, 2, 1, 0 };
+
+	switch (AFormat) {
+		case CAPSEO_FORMAT_BGRA:
+			*ALayout = bgra;
+			return true;
+		case CAPSEO_FORMAT_RGBA:
+			*ALayout = rgba;
+			return true;
+		case CAPSEO_FORMAT_ARGB:
+			*ALayout = argb;
+			return true;
+		case CAPSEO_FORMAT_ABGR:
+			*ALayout = abgr;
+			return true;
+		default:
+			return false;
+	}
+}
+
 /*! \brief decodes a single frame.
  *  \param cs the codec handle
  *  \param inbuf contains the capseo-encoded frame data.
@@ -77,12 +123,24 @@ int CapseoDecodeStreamHeader(uint8_t *inbuf, int inlen, capseo_info_t *out) {
  *  \retval CAPSEO_SUCCESS success.
  *  \retval CAPSEO_E_NOT_SUPPORTED reequested output format not implemented
  *
- *  \remarks Currently only one output format is supported. \b CAPSEO_FORMAT_YUV420.
+ *  \remarks Supported output formats are \b CAPSEO_FORMAT_YUV420, the 32 bit RGB formats
+ *           (\b CAPSEO_FORMAT_BGRA, \b CAPSEO_FORMAT_RGBA, \b CAPSEO_FORMAT_ARGB, \b CAPSEO_FORMAT_ABGR)
+ *           and \b CAPSEO_FORMAT_Y8, which spares decoding the chroma planes where the
+ *           encoded format stores them separately.
  */
 int CapseoDecodeFrame(capseo_t *cs, uint8_t *inbuf, int inlen, int cursor, capseo_frame_t *out) {
-	if (cs->info.format != CAPSEO_FORMAT_YUV420)
+	TPixelLayout layout;
+	const bool luma = cs->info.format == CAPSEO_FORMAT_Y8;
+	const bool rgb = cs->info.format != CAPSEO_FORMAT_YUV420 && !luma;
+
+	if (rgb && !pixelLayoutOf(cs->info.format, &layout))
 		return CAPSEO_E_NOT_SUPPORTED;
 
+	// RGB and luma output is taken from the YUV frame decoded into scratch space
+	capseo_frame_t yuvFrame = *out;
+	if (rgb || luma)
+		yuvFrame.buffer = cs->priv->yuvBuffer;
+
 	uint8_t *inptr = inbuf;
 	void *ch = cs->priv->compressor;
 
@@ -92,12 +150,52 @@ int CapseoDecodeFrame(capseo_t *cs, uint8_t *inbuf, int inlen, int cursor, capse
 	inptr += sizeof(*header);
 
 	// decode video frame
-	int size = cs->info.width * cs->info.height * 3 / 2;
-	int length = Decompress(ch, inptr, out->buffer);
+	uint8_t *yuv = yuvFrame.buffer;
+	const int yuvLength = videoWidth(cs) * videoHeight(cs) * 3 / 2;
+	int length;
+	if (!header->video.length) {
+		// a repeated frame (delta formats keep the previous frame as their reference anyway)
+		if (!repeatsFrames(cs->info.revision))
+			return CAPSEO_E_INVALID_HEADER;
+
+		memcpy(yuv, cs->priv->referenceBuffer, yuvLength);
+	} else {
+		switch (cs->info.encoded_video_fmt) {
+			case CAPSEO_FORMAT_ENCORE_QLZYUV420:
+				length = Decompress(ch, inptr, yuv);
+				assert(length == videoWidth(cs) * videoHeight(cs) * 3 / 2);
+				break;
+			case CAPSEO_FORMAT_ENCORE_QLZDYUV420:
+				if (int error = decodeDeltaFrame(cs, inptr, yuv))
+					return error;
+				break;
+			case CAPSEO_FORMAT_ENCORE_QLZTYUV420:
+				if (int error = decodeTileFrame(cs, inptr, header->video.length, yuv))
+					return error;
+				break;
+			case CAPSEO_FORMAT_ENCORE_QLZSYUV420:
+			case CAPSEO_FORMAT_ENCORE_QLZPYUV420:
+				if (int error = decodeSliceFrame(cs, inptr, header->video.length, yuv))
+					return error;
+				break;
+			case CAPSEO_FORMAT_ENCORE_HUFFYUV:
+				if (int error = decodeHuffYUVFrame(cs, inptr, header->video.length, yuv))
+					return error;
+				break;
+			case CAPSEO_FORMAT_ENCORE_QLZFYUV420:
+				if (int error = decodeFilteredFrame(cs, inptr, yuv))
+					return error;
+				break;
+			default:
+				return CAPSEO_E_NOT_SUPPORTED;
+		}
+
+		// (the cursor is yet to be drawn into yuv)
+		if (!cs->priv->deltaBuffer && repeatsFrames(cs->info.revision))
+			memcpy(cs->priv->referenceBuffer, yuv, yuvLength);
+	}
 	inptr += header->video.length;
 
-	assert(length == cs->info.width * cs->info.height * 3 / 2);
-
 	// decode cursor frame
 	if (header->cursor.length) {
 		capseo_cursor_t& cursor = cs->priv->FCursor;
@@ -105,19 +203,35 @@ int CapseoDecodeFrame(capseo_t *cs, uint8_t *inbuf, int inlen, int cursor, capse
 		cursor.y = header->cursor.y;
 		cursor.width = header->cursor.width;
 		cursor.height = header->cursor.height;
-#if 1
-		cursor.buffer = cs->priv->encodedBuffer; // use this as tmp storage, as it's currently unused
-		length = Decompress(ch, inptr, cursor.buffer);
-		assert(length == cursor.width * cursor.height * sizeof(uint32_t));
-#else
-		cursor.buffer = inptr;
-#endif
-		drawCursor(cs, out, &cursor, false);
+
+		if (cs->info.encoded_cursor_fmt == CAPSEO_FORMAT_ENCORE_QLZCARGB) {
+			if (int error = decodeCachedCursor(cs, inptr, header->cursor.length, &cursor))
+				return error;
+		} else {
+			cursor.buffer = cs->priv->encodedBuffer; // use this as tmp storage, as it's currently unused
+			length = Decompress(ch, inptr, cursor.buffer);
+			assert(length == cursor.width * cursor.height * sizeof(uint32_t));
+
+			// (each shape replaces the previous one)
+			prepareCursorSprite(cs, &cs->priv->cursorShapes[0].sprite, &cursor);
+			cs->priv->cursorSlot = 0;
+		}
 
 		inptr += header->cursor.length;
-	} else {
-		// cursor didn't change location/shape
-		drawCursor(cs, out, &cs->priv->FCursor, true);
+	}
+
+	// (otherwise the cursor didn't change location/shape)
+	if (cs->priv->cursorSlot != -1)
+		drawCursor(cs, &yuvFrame, &cs->priv->FCursor, &cs->priv->cursorShapes[cs->priv->cursorSlot].sprite);
+
+	if (rgb) {
+		const int width = videoWidth(cs);
+		const int height = videoHeight(cs);
+
+		uint8_t *planes[3] = { yuv, yuv + width * height, yuv + width * height * 5 / 4 };
+		convertYUV420toRGB(out->buffer, planes, width, height, &layout);
+	} else if (luma) {
+		memcpy(out->buffer, yuv, videoWidth(cs) * videoHeight(cs));
 	}
 
 	// finalize with sanity check
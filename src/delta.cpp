@@ -0,0 +1,361 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (inter-frame delta coding)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo.h"
+#include "capseo_private.h"
+#include "compress.h"
+
+#include <string.h>
+
+const unsigned DEFAULT_KEYFRAME_INTERVAL = 250;	//!< 10 seconds at 25 fps
+const int TILE_SIZE = 64;						//!< tile width/height (in luma pixels) of tiled formats
+
+/*! \brief computes dst = a ^ b and stores a into ref, in one pass.
+ *  \param size number of bytes to process
+ */
+static inline void xorDelta(uint8_t *dst, uint8_t *ref, const uint8_t *a, unsigned size) {
+	uint64_t *d = (uint64_t *)dst;
+	uint64_t *r = (uint64_t *)ref;
+	const uint64_t *s = (const uint64_t *)a;
+
+	for (unsigned i = size / sizeof(uint64_t); i > 0; --i) {
+		*d++ = *s ^ *r;
+		*r++ = *s++;
+	}
+
+	for (unsigned i = size & ~(sizeof(uint64_t) - 1); i < size; ++i) {
+		dst[i] = a[i] ^ ref[i];
+		ref[i] = a[i];
+	}
+}
+
+/*! \brief applies a XOR delta onto the reference frame and stores the result into both.
+ */
+static inline void xorApply(uint8_t *yuv, uint8_t *ref, unsigned size) {
+	uint64_t *d = (uint64_t *)yuv;
+	uint64_t *r = (uint64_t *)ref;
+
+	for (unsigned i = size / sizeof(uint64_t); i > 0; --i, ++d, ++r) {
+		*d ^= *r;
+		*r = *d;
+	}
+
+	for (unsigned i = size & ~(sizeof(uint64_t) - 1); i < size; ++i) {
+		yuv[i] ^= ref[i];
+		ref[i] = yuv[i];
+	}
+}
+
+/*! \brief iterates over the rows of all three planes of a single tile.
+ *
+ *  \p ACallback is invoked as (offset, bytes, plane) for each tile row,
+ *  where offset is relative to the plane's origin.
+ */
+template<typename TCallback>
+static inline void forEachTileRow(int width, int height, int tx, int ty, TCallback& ACallback) {
+	const int x0 = tx * TILE_SIZE;
+	const int y0 = ty * TILE_SIZE;
+	const int tw = width - x0 < TILE_SIZE ? width - x0 : TILE_SIZE;
+	const int th = height - y0 < TILE_SIZE ? height - y0 : TILE_SIZE;
+
+	for (int plane = 0; plane < 3; ++plane) {
+		const int shift = plane ? 1 : 0;
+		const int stride = width >> shift;
+
+		for (int y = y0 >> shift, y1 = (y0 + th) >> shift; y < y1; ++y)
+			if (!ACallback(y * stride + (x0 >> shift), tw >> shift, plane))
+				return;
+	}
+}
+
+//! tile row callback that finds out whether a tile differs from its reference
+struct TTileCompare {
+	uint8_t *yuv[3];
+	uint8_t *ref[3];
+	bool changed;
+
+	bool operator()(int offset, int bytes, int plane) {
+		changed = memcmp(yuv[plane] + offset, ref[plane] + offset, bytes) != 0;
+		return !changed;
+	}
+};
+
+//! tile row callback that appends a tile to the gather buffer and updates its reference
+struct TTileGather {
+	uint8_t *yuv[3];
+	uint8_t *ref[3];
+	uint8_t *outptr;
+
+	bool operator()(int offset, int bytes, int plane) {
+		memcpy(outptr, yuv[plane] + offset, bytes);
+		memcpy(ref[plane] + offset, yuv[plane] + offset, bytes);
+		outptr += bytes;
+		return true;
+	}
+};
+
+//! tile row callback that sums up the gathered bytes of a tile
+struct TTileCount {
+	int bytes;
+
+	bool operator()(int /*offset*/, int ABytes, int /*plane*/) {
+		bytes += ABytes;
+		return true;
+	}
+};
+
+//! tile row callback that patches a tile from the gather buffer into the reference
+struct TTileScatter {
+	uint8_t *ref[3];
+	uint8_t *inptr;
+
+	bool operator()(int offset, int bytes, int plane) {
+		memcpy(ref[plane] + offset, inptr, bytes);
+		inptr += bytes;
+		return true;
+	}
+};
+
+/*! \brief decides whether the next frame to be encoded shall be a keyframe.
+ *
+ *  Every keyframe_interval frames a keyframe is emitted, which is also
+ *  accounted for by this function.
+ */
+static inline bool nextIsKeyframe(capseo_t *cs) {
+	const unsigned interval = cs->info.keyframe_interval > 0
+		? unsigned(cs->info.keyframe_interval)
+		: DEFAULT_KEYFRAME_INTERVAL;
+
+	if (cs->priv->framesSinceKeyframe == 0 || cs->priv->framesSinceKeyframe >= interval) {
+		cs->priv->framesSinceKeyframe = 1;
+		return true;
+	}
+
+	++cs->priv->framesSinceKeyframe;
+	return false;
+}
+
+/*! \brief encodes the whole frame as keyframe and makes it the new reference frame.
+ */
+static inline int encodeKeyframe(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf) {
+	const unsigned size = videoWidth(cs) * videoHeight(cs) * 3 / 2;
+
+	TCapseoVideoHeader *header = (TCapseoVideoHeader *)outbuf;
+	header->type = CAPSEO_FRAME_KEY;
+	memcpy(cs->priv->referenceBuffer, yuv, size);
+
+	return sizeof(*header) + Compress(cs->priv->compressor, yuv, size, outbuf + sizeof(*header));
+}
+
+/*! \brief computes the maximum video payload length encodeDeltaFrame() may produce.
+ */
+int deltaFrameBound(capseo_t *cs) {
+	return sizeof(TCapseoVideoHeader) + CompressBound(cs->priv->compressor, videoWidth(cs) * videoHeight(cs) * 3 / 2);
+}
+
+/*! \brief computes the maximum video payload length encodeTileFrame() may produce.
+ */
+int tileFrameBound(capseo_t *cs) {
+	const int tilesX = (videoWidth(cs) + TILE_SIZE - 1) / TILE_SIZE;
+	const int tilesY = (videoHeight(cs) + TILE_SIZE - 1) / TILE_SIZE;
+
+	return deltaFrameBound(cs) + (tilesX * tilesY + 7) / 8;
+}
+
+/*! \brief encodes a video frame of format CAPSEO_FORMAT_ENCORE_QLZDYUV420.
+ *  \param cs the encoder handle
+ *  \param yuv the YUV 4:2:0 frame to encode
+ *  \param outbuf the buffer to store the encoded video payload into
+ *  \return the encoded video payload length
+ *
+ *  Delta frames store the XOR difference against their previous frame,
+ *  so that static screen areas compress into almost nothing.
+ */
+int encodeDeltaFrame(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf) {
+	if (nextIsKeyframe(cs))
+		return encodeKeyframe(cs, yuv, outbuf);
+
+	const unsigned size = videoWidth(cs) * videoHeight(cs) * 3 / 2;
+
+	TCapseoVideoHeader *header = (TCapseoVideoHeader *)outbuf;
+	header->type = CAPSEO_FRAME_DELTA;
+	xorDelta(cs->priv->deltaBuffer, cs->priv->referenceBuffer, yuv, size);
+
+	return sizeof(*header) + Compress(cs->priv->compressor, cs->priv->deltaBuffer, size, outbuf + sizeof(*header));
+}
+
+/*! \brief encodes a video frame of format CAPSEO_FORMAT_ENCORE_QLZTYUV420.
+ *  \param cs the encoder handle
+ *  \param yuv the YUV 4:2:0 frame to encode
+ *  \param outbuf the buffer to store the encoded video payload into
+ *  \return the encoded video payload length
+ *
+ *  The frame is split into tiles of TILE_SIZE x TILE_SIZE luma pixels (plus their chroma),
+ *  and only the tiles that changed since the previous frame are compressed and stored.
+ *  The payload of such a delta frame is a bitmap of changed tiles (one bit per tile,
+ *  row-major order, LSB first) followed by the compressed tiles.
+ */
+int encodeTileFrame(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf) {
+	if (nextIsKeyframe(cs))
+		return encodeKeyframe(cs, yuv, outbuf);
+
+	const int width = videoWidth(cs);
+	const int height = videoHeight(cs);
+	const int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	const int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	const int bitmapLength = (tilesX * tilesY + 7) / 8;
+
+	TCapseoVideoHeader *header = (TCapseoVideoHeader *)outbuf;
+	header->type = CAPSEO_FRAME_DELTA;
+
+	uint8_t *bitmap = outbuf + sizeof(*header);
+	bzero(bitmap, bitmapLength);
+
+	TTileCompare compare;
+	TTileGather gather;
+	for (int plane = 0; plane < 3; ++plane) {
+		compare.yuv[plane] = gather.yuv[plane] = planeOf(yuv, width, height, plane);
+		compare.ref[plane] = gather.ref[plane] = planeOf(cs->priv->referenceBuffer, width, height, plane);
+	}
+	gather.outptr = cs->priv->deltaBuffer;
+
+	for (int ty = 0, tile = 0; ty < tilesY; ++ty) {
+		for (int tx = 0; tx < tilesX; ++tx, ++tile) {
+			compare.changed = false;
+			forEachTileRow(width, height, tx, ty, compare);
+
+			if (compare.changed) {
+				bitmap[tile / 8] |= 1 << (tile % 8);
+				forEachTileRow(width, height, tx, ty, gather);
+			}
+		}
+	}
+
+	int length = sizeof(*header) + bitmapLength;
+
+	if (const int gathered = gather.outptr - cs->priv->deltaBuffer)
+		length += Compress(cs->priv->compressor, cs->priv->deltaBuffer, gathered, outbuf + length);
+
+	return length;
+}
+
+/*! \brief decodes a keyframe and makes it the new reference frame.
+ */
+static inline int decodeKeyframe(capseo_t *cs, uint8_t *payload, uint8_t *yuv) {
+	const unsigned size = videoWidth(cs) * videoHeight(cs) * 3 / 2;
+
+	if (Decompress(cs->priv->compressor, payload, yuv) != int(size))
+		return CAPSEO_E_INVALID_HEADER;
+
+	memcpy(cs->priv->referenceBuffer, yuv, size);
+	return CAPSEO_SUCCESS;
+}
+
+/*! \brief decodes a video frame of format CAPSEO_FORMAT_ENCORE_QLZDYUV420.
+ *  \param cs the decoder handle
+ *  \param inbuf the encoded video payload
+ *  \param yuv the buffer to store the decoded YUV 4:2:0 frame into
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_INVALID_HEADER unknown frame type
+ */
+int decodeDeltaFrame(capseo_t *cs, uint8_t *inbuf, uint8_t *yuv) {
+	const unsigned size = videoWidth(cs) * videoHeight(cs) * 3 / 2;
+
+	TCapseoVideoHeader *header = (TCapseoVideoHeader *)inbuf;
+	uint8_t *payload = inbuf + sizeof(*header);
+
+	switch (header->type) {
+		case CAPSEO_FRAME_KEY:
+			return decodeKeyframe(cs, payload, yuv);
+		case CAPSEO_FRAME_DELTA:
+			if (Decompress(cs->priv->compressor, payload, yuv) != int(size))
+				return CAPSEO_E_INVALID_HEADER;
+
+			xorApply(yuv, cs->priv->referenceBuffer, size);
+			return CAPSEO_SUCCESS;
+		default:
+			return CAPSEO_E_INVALID_HEADER;
+	}
+}
+
+/*! \brief decodes a video frame of format CAPSEO_FORMAT_ENCORE_QLZTYUV420.
+ *  \param cs the decoder handle
+ *  \param inbuf the encoded video payload
+ *  \param inlen the encoded video payload length
+ *  \param yuv the buffer to store the decoded YUV 4:2:0 frame into
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_INVALID_HEADER unknown frame type or corrupt tile data
+ *
+ *  Only the changed tiles are patched into the retained reference frame,
+ *  and only once the tile data has been found to cover them exactly.
+ */
+int decodeTileFrame(capseo_t *cs, uint8_t *inbuf, int inlen, uint8_t *yuv) {
+	const int width = videoWidth(cs);
+	const int height = videoHeight(cs);
+	const int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	const int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	const int bitmapLength = (tilesX * tilesY + 7) / 8;
+
+	TCapseoVideoHeader *header = (TCapseoVideoHeader *)inbuf;
+
+	if (inlen < int(sizeof(*header)))
+		return CAPSEO_E_INVALID_HEADER;
+
+	switch (header->type) {
+		case CAPSEO_FRAME_KEY:
+			return decodeKeyframe(cs, inbuf + sizeof(*header), yuv);
+		case CAPSEO_FRAME_DELTA:
+			break;
+		default:
+			return CAPSEO_E_INVALID_HEADER;
+	}
+
+	if (inlen < int(sizeof(*header)) + bitmapLength)
+		return CAPSEO_E_INVALID_HEADER;
+
+	const uint8_t *bitmap = inbuf + sizeof(*header);
+	uint8_t *payload = inbuf + sizeof(*header) + bitmapLength;
+	const int payloadLength = inlen - sizeof(*header) - bitmapLength;
+
+	// the tile data must exactly cover the changed tiles, so a corrupt frame leaves the reference alone
+	TTileCount count;
+	count.bytes = 0;
+	for (int ty = 0, tile = 0; ty < tilesY; ++ty)
+		for (int tx = 0; tx < tilesX; ++tx, ++tile)
+			if (bitmap[tile / 8] & (1 << (tile % 8)))
+				forEachTileRow(width, height, tx, ty, count);
+
+	if (count.bytes) {
+		if (DecompressedSize(cs->priv->compressor, payload, payloadLength) != count.bytes
+		 || Decompress(cs->priv->compressor, payload, cs->priv->deltaBuffer) != count.bytes)
+			return CAPSEO_E_INVALID_HEADER;
+	} else if (payloadLength) {
+		return CAPSEO_E_INVALID_HEADER;
+	}
+
+	TTileScatter scatter;
+	for (int plane = 0; plane < 3; ++plane)
+		scatter.ref[plane] = planeOf(cs->priv->referenceBuffer, width, height, plane);
+	scatter.inptr = cs->priv->deltaBuffer;
+
+	for (int ty = 0, tile = 0; ty < tilesY; ++ty)
+		for (int tx = 0; tx < tilesX; ++tx, ++tile)
+			if (bitmap[tile / 8] & (1 << (tile % 8)))
+				forEachTileRow(width, height, tx, ty, scatter);
+
+	memcpy(yuv, cs->priv->referenceBuffer, width * height * 3 / 2);
+
+	return CAPSEO_SUCCESS;
+}
+
+// vim:ai:noet:ts=4:nowrap
@@ -44,14 +44,15 @@ int CapseoEncodeStreamHeader(capseo_t *cs, uint8_t **buffer, int *buflen) {
 	header.magic[0] = 'C';
 	header.magic[1] = 'P';
 	header.magic[2] = 'S';
-	header.magic[3] = 0X01; // revision
+	header.magic[3] = CAPSEO_STREAM_REVISION;
 
 	header.width = htonl(long(cs->info.width / pow(2, cs->info.scale)));
 	header.height = htonl(long(cs->info.height / pow(2, cs->info.scale)));
 	header.scale = htonl(cs->info.scale);
 	header.fps = htonl(cs->info.fps);
-	header.video_format = htonl(CAPSEO_FORMAT_ENCORE_QLZYUV420);
-	header.cursor_format = htonl(CAPSEO_FORMAT_ENCORE_QLZARGB);
+	header.video_format = htonl(CAPSEO_STREAM_FORMAT(cs->info.encoded_video_fmt, cs->info.compression, cs->info.compression_level));
+	header.cursor_format = htonl(CAPSEO_STREAM_FORMAT(cs->info.encoded_cursor_fmt, cs->info.compression, cs->info.compression_level));
+	header.orientation = htonl(cs->info.orientation);
 
 	memcpy(cs->priv->encodedBuffer, &header, sizeof(header));
 
@@ -78,7 +79,7 @@ capseo_frame_id_t CapseoCreateFrameID(capseo_t *cs) {
 
 /*! \brief encodes given frame.
  *  \param cs the codec handle to operate on
- *  \param frame_in contains the raw frame buffer. its result after leaving this call is <b>undefined</b>.
+ *  \param frame_in contains the raw frame buffer, bottom-up as read by glReadPixels(). it is left untouched.
  *  \param id frame ID that belongs to this frame.
  *  \param outbuf pointer to the encoded buffer will be stored here.
  *  \param outlen encoded frame length
@@ -99,6 +100,143 @@ capseo_frame_id_t CapseoCreateFrameID(capseo_t *cs) {
  *  \endcode
  */
 int CapseoEncodeFrame(capseo_t *cs, uint8_t *frame_in, capseo_frame_id_t id, capseo_cursor_t *cursor, uint8_t **outbuf, int *outlen) {
+	return CapseoEncodeFrameEx(cs, frame_in, 0, CAPSEO_INPUT_BOTTOM_UP, id, cursor, outbuf, outlen);
+}
+
+/*! \brief encodes given frame, read straight from (possibly padded or read-only) memory.
+ *  \param cs the codec handle to operate on
+ *  \param frame_in contains the raw frame buffer. it is left untouched.
+ *  \param stride distance between the starts of two rows in bytes, or 0 for tightly packed rows.
+ *  \param flags CAPSEO_INPUT_BOTTOM_UP, if the frame's rows are stored bottom-up, in which case they
+ *               are flipped for top-down streams. Otherwise they are taken in the stream's row order.
+ *  \param id frame ID that belongs to this frame.
+ *  \param outbuf pointer to the encoded buffer will be stored here.
+ *  \param outlen encoded frame length
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_INVALID_ARGUMENT \p stride is smaller than a row
+ *  \retval CAPSEO_E_NOT_SUPPORTED padded YUV 4:2:0 input, or such input to be flipped
+ *  \see CapseoEncodeFrame(), CapseoEncodeFrameInto()
+ *
+ *  This allows encoding e.g. mapped PBOs or XShm images without copying them first.
+ */
+int CapseoEncodeFrameEx(capseo_t *cs, const uint8_t *frame_in, int stride, int flags, capseo_frame_id_t id, capseo_cursor_t *cursor, uint8_t **outbuf, int *outlen) {
+	capseo_private_t *priv = cs->priv;
+
+	// (the cursor may be larger than anticipated)
+	const unsigned bound = CapseoEncodeFrameBound(cs, cursor);
+	if (bound > priv->encodedBufferLength) {
+		delete[] priv->encodedBuffer;
+		priv->encodedBuffer = new uint8_t[bound];
+		priv->encodedBufferLength = bound;
+	}
+
+	*outbuf = priv->encodedBuffer;
+
+	return CapseoEncodeFrameInto(cs, frame_in, stride, flags, id, cursor, *outbuf, bound, outlen);
+}
+
+static inline uint64_t rotateLeft(uint64_t x, int n) {
+	return (x << n) | (x >> (64 - n));
+}
+
+/*! \brief computes a 64 bit hash of the given yuv frame, to spot repeated frames.
+ *
+ *  Four independent lanes of multiply-rotate rounds (as in xxHash) keep up with
+ *  the memory bandwidth, so hashing costs next to nothing compared to compressing.
+ */
+static uint64_t frameHash(const uint8_t *yuv, unsigned length) {
+	const uint64_t prime1 = 0x9e3779b185ebca87ULL;
+	const uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+
+	uint64_t lanes[4] = { prime1 + prime2, prime2, 0, 0 - prime1 };
+
+	unsigned i = 0;
+	for (; i + sizeof(lanes) <= length; i += sizeof(lanes)) {
+		for (int k = 0; k < 4; ++k) {
+			uint64_t word;
+			memcpy(&word, yuv + i + k * sizeof(word), sizeof(word));
+
+			lanes[k] = rotateLeft(lanes[k] + word * prime2, 31) * prime1;
+		}
+	}
+
+	uint64_t hash = length;
+	for (int k = 0; k < 4; ++k)
+		hash = rotateLeft(hash ^ lanes[k], 27) * prime1;
+
+	for (; i < length; ++i)
+		hash = rotateLeft(hash ^ yuv[i], 11) * prime1;
+
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+
+	return hash;
+}
+
+/*! \brief computes the maximum video payload length of the handle's encoded video format.
+ */
+static int videoFrameBound(capseo_t *cs) {
+	switch (cs->info.encoded_video_fmt) {
+		case CAPSEO_FORMAT_ENCORE_QLZYUV420:
+			return CompressBound(cs->priv->compressor, videoWidth(cs) * videoHeight(cs) * 3 / 2);
+		case CAPSEO_FORMAT_ENCORE_QLZDYUV420:
+			return deltaFrameBound(cs);
+		case CAPSEO_FORMAT_ENCORE_QLZTYUV420:
+			return tileFrameBound(cs);
+		case CAPSEO_FORMAT_ENCORE_QLZSYUV420:
+		case CAPSEO_FORMAT_ENCORE_QLZPYUV420:
+			return sliceFrameBound(cs);
+		case CAPSEO_FORMAT_ENCORE_HUFFYUV:
+			return huffyuvFrameBound(cs);
+		case CAPSEO_FORMAT_ENCORE_QLZFYUV420:
+			return filteredFrameBound(cs);
+		default:
+			return 0;
+	}
+}
+
+/*! \brief computes the maximum length of an encoded frame.
+ *  \param cs the codec handle
+ *  \param cursor the cursor to be encoded along with the frame, or NULL
+ *  \return the number of bytes a buffer passed to CapseoEncodeFrameInto() must provide
+ */
+int CapseoEncodeFrameBound(capseo_t *cs, capseo_cursor_t *cursor) {
+	int bound = sizeof(TCapseoFrameHeader) + videoFrameBound(cs);
+
+	if (cursor && cursor->buffer)
+		bound += sizeof(TCapseoCursorHeader) + CompressBound(cs->priv->compressor, cursor->width * cursor->height * 4);
+
+	return bound;
+}
+
+/*! \brief encodes given frame into a caller provided buffer.
+ *  \param cs the codec handle to operate on
+ *  \param frame_in contains the raw frame buffer. it is left untouched.
+ *  \param stride distance between the starts of two rows in bytes, or 0 for tightly packed rows.
+ *  \param flags CAPSEO_INPUT_BOTTOM_UP, if the frame's rows are stored bottom-up, in which case they
+ *               are flipped for top-down streams. Otherwise they are taken in the stream's row order.
+ *  \param id frame ID that belongs to this frame.
+ *  \param outbuf the buffer to store the encoded frame into
+ *  \param outsize size of \p outbuf, at least CapseoEncodeFrameBound() bytes
+ *  \param outlen encoded frame length
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_INVALID_ARGUMENT \p outsize or \p stride too small
+ *  \retval CAPSEO_E_NOT_SUPPORTED padded YUV 4:2:0 input, or such input to be flipped
+ *  \see CapseoEncodeFrameBound(), CapseoEncodeFrameEx()
+ *
+ *  As the codec handle does not retain \p outbuf, callers may keep several
+ *  encoded frames in flight, e.g. to write them out asynchronously.
+ *
+ *  A frame whose video is identical to the previous one's (after colour conversion) is
+ *  stored without video payload, for the decoder to repeat the previous frame. Frames are
+ *  told apart by a 64 bit hash only, as keeping the previous frame just to compare it
+ *  would cost more than the odds of a collision are worth.
+ */
+int CapseoEncodeFrameInto(capseo_t *cs, const uint8_t *frame_in, int stride, int flags, capseo_frame_id_t id, capseo_cursor_t *cursor, uint8_t *outbuf, int outsize, int *outlen) {
+	if (outsize < CapseoEncodeFrameBound(cs, cursor))
+		return CAPSEO_E_INVALID_ARGUMENT;
+
 	int width = cs->info.width;
 	int height = cs->info.height;
 	void *ch = cs->priv->compressor;
@@ -109,18 +247,38 @@ int CapseoEncodeFrame(capseo_t *cs, uint8_t *frame_in, capseo_frame_id_t id, cap
 			if (cs->info.scale != 0) // TODO scaling support
 				return CAPSEO_E_NOT_IMPLEMENTED;
 
-			yuvBuffer = (uint8_t *)frame_in;
+			if ((stride && stride != width) || flipsInput(&cs->info, flags))
+				return CAPSEO_E_NOT_SUPPORTED;
+
+			// (the video encoders never write to their input)
+			yuvBuffer = const_cast<uint8_t *>(frame_in);
 			break;
 		case CAPSEO_FORMAT_BGRA: {
-			for (int i = cs->info.scale; i > 0; --i, width /= 2, height /= 2)
-				scaleBGRA(frame_in, width, height);
+			const int scale = cs->info.scale;
+			width >>= scale;
+			height >>= scale;
+
+			if (!stride)
+				stride = cs->info.width * 4;
+			else if (stride < cs->info.width * 4)
+				return CAPSEO_E_INVALID_ARGUMENT;
 
 			uint8_t *yuv[3];
 			yuv[0] = cs->priv->yuvBuffer;
 			yuv[1] = yuv[0] + width * height;
 			yuv[2] = yuv[1] + width * height / 4;
 
-			convertBGRAtoYUV420(yuv, (uint8_t *)frame_in, width, height);
+			// downscaling and flipping are fused into the conversion, leaving frame_in untouched
+			if (flipsInput(&cs->info, flags)) {
+				const uint8_t *top = frame_in + long(cs->info.height - 1) * stride;
+				convertBGRAtoYUV420Scaled(yuv, top, -stride, cs->info.width, cs->info.height, scale, cs->priv->scaleBuffer);
+			} else if (scale || stride != cs->info.width * 4) {
+				convertBGRAtoYUV420Scaled(yuv, frame_in, stride, cs->info.width, cs->info.height, scale, cs->priv->scaleBuffer);
+			} else {
+				// (does not write to its source either)
+				convertBGRAtoYUV420(yuv, const_cast<uint8_t *>(frame_in), width, height);
+			}
+
 			yuvBuffer = yuv[0];
 			break;
 		}
@@ -128,10 +286,9 @@ int CapseoEncodeFrame(capseo_t *cs, uint8_t *frame_in, capseo_frame_id_t id, cap
 			return CAPSEO_E_INVALID_ARGUMENT;
 	}
 
-	*outbuf = cs->priv->encodedBuffer;
 	*outlen = 0;
 
-	uint8_t *outptr = cs->priv->encodedBuffer;
+	uint8_t *outptr = outbuf;
 
 	// prepare frame header encode
 	TCapseoFrameHeader frameHeader;
@@ -140,21 +297,52 @@ int CapseoEncodeFrame(capseo_t *cs, uint8_t *frame_in, capseo_frame_id_t id, cap
 	outptr += sizeof(frameHeader);
 	*outlen += sizeof(frameHeader);
 
-	// encode video frame
-	frameHeader.video.length = Compress(ch, yuvBuffer, width * height * 3 / 2, outptr);
+	const uint64_t hash = frameHash(yuvBuffer, width * height * 3 / 2);
+	const bool repeated = cs->priv->frameHashed && hash == cs->priv->frameHash;
+
+	cs->priv->frameHash = hash;
+	cs->priv->frameHashed = true;
+
+	// encode video frame (a repeated one is left empty)
+	if (!repeated) {
+		switch (cs->info.encoded_video_fmt) {
+			case CAPSEO_FORMAT_ENCORE_QLZYUV420:
+				frameHeader.video.length = Compress(ch, yuvBuffer, width * height * 3 / 2, outptr);
+				break;
+			case CAPSEO_FORMAT_ENCORE_QLZDYUV420:
+				frameHeader.video.length = encodeDeltaFrame(cs, yuvBuffer, outptr);
+				break;
+			case CAPSEO_FORMAT_ENCORE_QLZTYUV420:
+				frameHeader.video.length = encodeTileFrame(cs, yuvBuffer, outptr);
+				break;
+			case CAPSEO_FORMAT_ENCORE_QLZSYUV420:
+			case CAPSEO_FORMAT_ENCORE_QLZPYUV420:
+				frameHeader.video.length = encodeSliceFrame(cs, yuvBuffer, outptr);
+				break;
+			case CAPSEO_FORMAT_ENCORE_HUFFYUV:
+				frameHeader.video.length = encodeHuffYUVFrame(cs, yuvBuffer, outptr);
+				break;
+			case CAPSEO_FORMAT_ENCORE_QLZFYUV420:
+				frameHeader.video.length = encodeFilteredFrame(cs, yuvBuffer, outptr);
+				break;
+			default:
+				return CAPSEO_E_NOT_SUPPORTED;
+		}
+	}
 	outptr += frameHeader.video.length;
 	*outlen += frameHeader.video.length;
 
 	// encode cursor frame
 	if (cursor && cursor->buffer) {
 		// store cursor image compressed, but keep colour space
-#if 1
-		frameHeader.cursor.length = Compress(ch, cursor->buffer, cursor->width * cursor->height * 4, outptr);
-#else
-		// raw
-		frameHeader.cursor.length = cursor->width * cursor->height * 4 * 2;
-		memcpy(outptr, cursor->buffer, frameHeader.cursor.length);
-#endif
+		if (cs->info.encoded_cursor_fmt == CAPSEO_FORMAT_ENCORE_QLZCARGB)
+			frameHeader.cursor.length = encodeCachedCursor(cs, cursor, outptr);
+		else
+			frameHeader.cursor.length = Compress(ch, cursor->buffer, cursor->width * cursor->height * 4, outptr);
+	}
+
+	// (a cached cursor that neither moved nor changed its shape is left out)
+	if (frameHeader.cursor.length) {
 		frameHeader.cursor.x = cursor->x;
 		frameHeader.cursor.y = cursor->y;
 		frameHeader.cursor.width = cursor->width;
@@ -172,10 +360,10 @@ int CapseoEncodeFrame(capseo_t *cs, uint8_t *frame_in, capseo_frame_id_t id, cap
 	}
 
 	// finalize header encode
-	memcpy(cs->priv->encodedBuffer, &frameHeader, sizeof(frameHeader));
+	memcpy(outbuf, &frameHeader, sizeof(frameHeader));
 
 	// sanity check
-	assert((outptr - cs->priv->encodedBuffer) == *outlen);
+	assert((outptr - outbuf) == *outlen);
 
 	return CAPSEO_SUCCESS;
 }
@@ -0,0 +1,224 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (PNG style row filtered frame coding)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo.h"
+#include "capseo_private.h"
+#include "compress.h"
+#include "filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Each row of each plane gets replaced by its residuals against one of PNG's
+ * predictors (with one byte per pixel), chosen per row by the smallest sum of
+ * residual magnitudes. The filtered frame is preceded by the filter of each
+ * row (Y rows first, then U and V rows) and compressed as a whole.
+ */
+
+// {{{ generic kernels
+static inline int paeth(int a, int b, int c) {
+	const int pa = abs(b - c);
+	const int pb = abs(a - c);
+	const int pc = abs(a + b - 2 * c);
+
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+/*! \brief predicts a byte by the given filter out of its left (a), upper (b) and upper left (c) neighbour.
+ */
+template<int AFilter>
+static inline int predict(int a, int b, int c) {
+	switch (AFilter) {
+		case CAPSEO_FILTER_LEFT:
+			return a;
+		case CAPSEO_FILTER_UP:
+			return b;
+		case CAPSEO_FILTER_AVERAGE:
+			return (a + b) >> 1;
+		case CAPSEO_FILTER_PAETH:
+			return paeth(a, b, c);
+		default:
+			return 0;
+	}
+}
+
+template<int AFilter>
+static inline uint32_t filterRange(uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t from, uint32_t to) {
+	uint32_t cost = 0;
+
+	for (uint32_t x = from; x < to; ++x) {
+		const uint8_t r = row[x] - predict<AFilter>(x ? row[x - 1] : 0, above[x], x ? above[x - 1] : 0);
+
+		dst[x] = r;
+		cost += r < 128 ? r : 256 - r;
+	}
+
+	return cost;
+}
+
+template<int AFilter>
+static inline void unfilterRange(uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t from, uint32_t to) {
+	for (uint32_t x = from; x < to; ++x)
+		dst[x] = residuals[x] + predict<AFilter>(x ? dst[x - 1] : 0, above[x], x ? above[x - 1] : 0);
+}
+
+uint32_t filterRange_generic(int filter, uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t from, uint32_t to) {
+	switch (filter) {
+		case CAPSEO_FILTER_LEFT:
+			return filterRange<CAPSEO_FILTER_LEFT>(dst, row, above, from, to);
+		case CAPSEO_FILTER_UP:
+			return filterRange<CAPSEO_FILTER_UP>(dst, row, above, from, to);
+		case CAPSEO_FILTER_AVERAGE:
+			return filterRange<CAPSEO_FILTER_AVERAGE>(dst, row, above, from, to);
+		case CAPSEO_FILTER_PAETH:
+			return filterRange<CAPSEO_FILTER_PAETH>(dst, row, above, from, to);
+		default:
+			return filterRange<CAPSEO_FILTER_NONE>(dst, row, above, from, to);
+	}
+}
+
+void unfilterRange_generic(int filter, uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t from, uint32_t to) {
+	switch (filter) {
+		case CAPSEO_FILTER_LEFT:
+			unfilterRange<CAPSEO_FILTER_LEFT>(dst, residuals, above, from, to);
+			break;
+		case CAPSEO_FILTER_UP:
+			unfilterRange<CAPSEO_FILTER_UP>(dst, residuals, above, from, to);
+			break;
+		case CAPSEO_FILTER_AVERAGE:
+			unfilterRange<CAPSEO_FILTER_AVERAGE>(dst, residuals, above, from, to);
+			break;
+		case CAPSEO_FILTER_PAETH:
+			unfilterRange<CAPSEO_FILTER_PAETH>(dst, residuals, above, from, to);
+			break;
+		default:
+			memcpy(dst + from, residuals + from, to - from);
+			break;
+	}
+}
+
+uint32_t filterRow_generic(int filter, uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t width) {
+	return filterRange_generic(filter, dst, row, above, 0, width);
+}
+
+void unfilterRow_generic(int filter, uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t width) {
+	unfilterRange_generic(filter, dst, residuals, above, 0, width);
+}
+// }}}
+
+/*! number of rows of a YUV 4:2:0 frame, i.e. of filters preceding the filtered frame */
+static inline int rowCount(int height) {
+	return height + height / 2 * 2;
+}
+
+static inline int filteredFrameLength(capseo_t *cs) {
+	return rowCount(videoHeight(cs)) + videoWidth(cs) * videoHeight(cs) * 3 / 2;
+}
+
+/*! \brief returns the two rows of scratch space following the filtered frame in the filter buffer.
+ *
+ *  The first row holds candidate rows while encoding, the second one is cleared
+ *  to serve as the row above the first one of each plane (on every call, as a
+ *  corrupt frame may have decompressed beyond the filtered frame).
+ */
+static inline uint8_t *scratchRows(capseo_t *cs) {
+	uint8_t *scratch = cs->priv->filterBuffer + filteredFrameLength(cs);
+	memset(scratch + videoWidth(cs), 0, videoWidth(cs));
+
+	return scratch;
+}
+
+int filteredFrameBound(capseo_t *cs) {
+	return CompressBound(cs->priv->compressor, filteredFrameLength(cs));
+}
+
+/*! \brief row filters the given frame and compresses the result.
+ *  \return the length of the encoded frame
+ */
+int encodeFilteredFrame(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf) {
+	const int width = videoWidth(cs);
+	const int height = videoHeight(cs);
+	TFilterRow filterRow = filterKernels()->filterRow;
+
+	uint8_t *filters = cs->priv->filterBuffer;
+	uint8_t *filtered = filters + rowCount(height);
+
+	// a candidate row and the row above the first one
+	uint8_t *candidate = scratchRows(cs);
+	const uint8_t *zero = candidate + width;
+
+	for (int p = 0; p < 3; ++p) {
+		const int w = p ? width / 2 : width;
+		const int h = p ? height / 2 : height;
+		const uint8_t *plane = planeOf(yuv, width, height, p);
+		uint8_t *out = planeOf(filtered, width, height, p);
+
+		for (int y = 0; y < h; ++y) {
+			const uint8_t *row = plane + y * w;
+			const uint8_t *above = y ? row - w : zero;
+			uint8_t *dst = out + y * w;
+
+			int best = CAPSEO_FILTER_NONE;
+			uint32_t bestCost = filterRow(best, dst, row, above, w);
+
+			for (int filter = CAPSEO_FILTER_LEFT; filter <= CAPSEO_FILTER_PAETH && bestCost; ++filter) {
+				const uint32_t cost = filterRow(filter, candidate, row, above, w);
+
+				if (cost < bestCost) {
+					memcpy(dst, candidate, w);
+					best = filter;
+					bestCost = cost;
+				}
+			}
+
+			*filters++ = best;
+		}
+	}
+
+	return Compress(cs->priv->compressor, cs->priv->filterBuffer, filteredFrameLength(cs), outbuf);
+}
+
+int decodeFilteredFrame(capseo_t *cs, uint8_t *inbuf, uint8_t *yuv) {
+	const int width = videoWidth(cs);
+	const int height = videoHeight(cs);
+	TUnfilterRow unfilterRow = filterKernels()->unfilterRow;
+
+	if (Decompress(cs->priv->compressor, inbuf, cs->priv->filterBuffer) != filteredFrameLength(cs))
+		return CAPSEO_E_INVALID_HEADER;
+
+	const uint8_t *filters = cs->priv->filterBuffer;
+	uint8_t *filtered = cs->priv->filterBuffer + rowCount(height);
+
+	for (int i = 0; i < rowCount(height); ++i)
+		if (filters[i] > CAPSEO_FILTER_PAETH)
+			return CAPSEO_E_INVALID_HEADER;
+
+	const uint8_t *zero = scratchRows(cs) + width;
+
+	for (int p = 0; p < 3; ++p) {
+		const int w = p ? width / 2 : width;
+		const int h = p ? height / 2 : height;
+		const uint8_t *in = planeOf(filtered, width, height, p);
+		uint8_t *plane = planeOf(yuv, width, height, p);
+
+		for (int y = 0; y < h; ++y) {
+			uint8_t *row = plane + y * w;
+
+			unfilterRow(*filters++, row, in + y * w, y ? row - w : zero, w);
+		}
+	}
+
+	return CAPSEO_SUCCESS;
+}
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,46 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (row filter kernels)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#ifndef capseo_filter_h
+#define capseo_filter_h
+
+#include "capseo_private.h"
+
+/* All kernels take a CAPSEO_FILTER_* filter and must produce bit-exact results
+ * compared to the generic implementation. The row above the first one of a plane
+ * is passed as a row of zeros.
+ */
+
+/*! filters a row of \p width bytes into \p dst.
+ *  \return the sum of the residuals' magnitudes (as signed bytes), to choose a row's filter by */
+typedef uint32_t (*TFilterRow)(int filter, uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t width);
+
+/*! reconstructs a row of \p width bytes out of its residuals into \p dst. */
+typedef void (*TUnfilterRow)(int filter, uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t width);
+
+/*! generic filtering of the row's bytes [\p from, \p to), e.g. to finish off a row */
+uint32_t filterRange_generic(int filter, uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t from, uint32_t to);
+void unfilterRange_generic(int filter, uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t from, uint32_t to);
+
+uint32_t filterRow_generic(int filter, uint8_t *dst, const uint8_t *row, const uint8_t *above, uint32_t width);
+void unfilterRow_generic(int filter, uint8_t *dst, const uint8_t *residuals, const uint8_t *above, uint32_t width);
+
+struct TFilterKernels {
+	TFilterRow filterRow;
+	TUnfilterRow unfilterRow;
+};
+
+/*! retrieves the row filter kernels to use, as chosen by the accel library (see arch-*) */
+const TFilterKernels *filterKernels();
+
+#endif
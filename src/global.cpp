@@ -47,6 +47,31 @@ int validateEncodeInfo(capseo_info_t *info) {//{{{
 			return CAPSEO_E_INVALID_ARGUMENT;
 	}
 
+	switch (info->encoded_video_fmt) {
+		case CAPSEO_FORMAT_ENCORE_QLZYUV420:
+		case CAPSEO_FORMAT_ENCORE_QLZDYUV420:
+		case CAPSEO_FORMAT_ENCORE_QLZTYUV420:
+		case CAPSEO_FORMAT_ENCORE_QLZSYUV420:
+		case CAPSEO_FORMAT_ENCORE_HUFFYUV:
+		case CAPSEO_FORMAT_ENCORE_QLZFYUV420:
+		case CAPSEO_FORMAT_ENCORE_QLZPYUV420:
+		case 0: // 0 means default
+			break; // supported
+		default:
+			return CAPSEO_E_NOT_SUPPORTED;
+	}
+
+	switch (info->orientation) {
+		case CAPSEO_ORIENTATION_BOTTOM_UP:
+		case CAPSEO_ORIENTATION_TOP_DOWN:
+			break; // valid
+		default:
+			return CAPSEO_E_INVALID_ARGUMENT;
+	}
+
+	if (info->width <= 0 || info->height <= 0 || info->scale < 0 || info->scale > MAX_SCALE_LEVELS)
+		return CAPSEO_E_INVALID_ARGUMENT;
+
 	{	// validate width/height
 		int w = info->width & ~((1 << (info->scale + 1)) - 1);
 		int h = info->height & ~((1 << (info->scale + 1)) - 1);
@@ -64,8 +89,8 @@ int validateDecodeInfo(capseo_info_t *info) {//{{{
 		case CAPSEO_FORMAT_RGBA:
 		case CAPSEO_FORMAT_ARGB:
 		case CAPSEO_FORMAT_ABGR:
-			return CAPSEO_E_NOT_IMPLEMENTED;
 		case CAPSEO_FORMAT_YUV420:
+		case CAPSEO_FORMAT_Y8:
 			break; // supported
 		default:
 			return CAPSEO_E_INVALID_ARGUMENT;
@@ -83,8 +108,17 @@ int validateDecodeInfo(capseo_info_t *info) {//{{{
 			return CAPSEO_E_INVALID_ARGUMENT;
 	}
 
-	// validate width/height
-	if (info->width || info->height)
+	// (filled out by CapseoDecodeStreamHeader())
+	switch (info->orientation) {
+		case CAPSEO_ORIENTATION_BOTTOM_UP:
+		case CAPSEO_ORIENTATION_TOP_DOWN:
+			break; // valid
+		default:
+			return CAPSEO_E_INVALID_ARGUMENT;
+	}
+
+	// validate width/height (of the stream's frames, as filled out by CapseoDecodeStreamHeader())
+	if (info->width <= 0 || info->height <= 0)
 		return CAPSEO_E_INVALID_ARGUMENT;
 
 	return CAPSEO_SUCCESS;
@@ -96,34 +130,85 @@ int validateDecodeInfo(capseo_info_t *info) {//{{{
  *  \retval CAPSEO_SUCCESS success
  *  \retval CAPSEO_E_INVALID_ARGUMENT invalid argument passed (also when something within a passed structure is invalid)
  *  \retval CAPSEO_E_NOT_IMPLEMENTED error (most likely because you passed wrong with/height values
+ *  \retval CAPSEO_E_NOT_SUPPORTED unknown compression backend or level
  *  \sa CapseoFinalize(), CapseoEncodeInit()
  */
 int CapseoInitialize(capseo_t *cs, capseo_info_t *info) {
 	bzero(cs, sizeof(*cs));
 
+	switch (info->mode) {
+		case CAPSEO_MODE_ENCODE:
+			if (int error = validateEncodeInfo(info))
+				return error;
+			break;
+		case CAPSEO_MODE_DECODE:
+			if (int error = validateDecodeInfo(info))
+				return error;
+			break;
+		default:
+			return CAPSEO_E_INVALID_ARGUMENT;
+	}
+
+	// (also reached for streams of backends unknown to this build)
+	const TCompressionBackend *backend = findCompressionBackend(info->compression, info->compression_level);
+	if (!backend)
+		return CAPSEO_E_NOT_SUPPORTED;
+
+	// record the level actually used, e.g. in the stream header
+	info->compression_level = backend->level;
+
 	cs->priv = new capseo_private_t;
 	bzero(cs->priv, sizeof(*cs->priv));
 
-	info->encoded_video_fmt = CAPSEO_FORMAT_ENCORE_QLZYUV420;
-	info->encoded_cursor_fmt = CAPSEO_FORMAT_ENCORE_QLZARGB;
+	if (!info->encoded_video_fmt)
+		info->encoded_video_fmt = CAPSEO_FORMAT_ENCORE_QLZYUV420;
+
+	if (!info->encoded_cursor_fmt)
+		info->encoded_cursor_fmt = CAPSEO_FORMAT_ENCORE_QLZCARGB;
 
 	cs->info = *info;
 
 	switch (info->mode) {
 		case CAPSEO_MODE_ENCODE:
-			validateEncodeInfo(info);
-			cs->priv->compressor = CompressorCreate();
+			cs->priv->compressor = CompressorCreate(info->compression, info->compression_level);
 			break;
 		case CAPSEO_MODE_DECODE:
-			validateDecodeInfo(info);
-			cs->priv->compressor = DecompressorCreate();
-			break; 
-		default:
-			return CAPSEO_E_INVALID_ARGUMENT;
+			cs->priv->compressor = DecompressorCreate(info->compression, info->compression_level);
+			break;
 	}
 
 	cs->priv->yuvBuffer = new uint8_t[info->width * info->height * 3 / 2];
 
+	if (info->mode == CAPSEO_MODE_ENCODE && info->scale > 0) {
+		const uint32_t scaleLength = scaleScratchLength(info->width, info->scale);
+
+		cs->priv->scaleBuffer = new uint8_t[scaleLength];
+		bzero(cs->priv->scaleBuffer, scaleLength);
+	}
+
+	const bool delta = info->encoded_video_fmt == CAPSEO_FORMAT_ENCORE_QLZDYUV420
+		|| info->encoded_video_fmt == CAPSEO_FORMAT_ENCORE_QLZTYUV420;
+
+	if (delta)
+		cs->priv->deltaBuffer = new uint8_t[info->width * info->height * 3 / 2];
+
+	// (decoders repeat the previous frame out of it, if the stream may contain repeats at all)
+	if (delta || (info->mode == CAPSEO_MODE_DECODE && repeatsFrames(info->revision))) {
+		cs->priv->referenceBuffer = new uint8_t[info->width * info->height * 3 / 2];
+		bzero(cs->priv->referenceBuffer, info->width * info->height * 3 / 2);
+	}
+
+	if (info->encoded_video_fmt == CAPSEO_FORMAT_ENCORE_QLZSYUV420
+			|| info->encoded_video_fmt == CAPSEO_FORMAT_ENCORE_QLZPYUV420)
+		initializeSlices(cs);
+
+	// (preceded by a filter per row, i.e. at most two per luma row, and followed by two scratch rows)
+	if (info->encoded_video_fmt == CAPSEO_FORMAT_ENCORE_QLZFYUV420)
+		cs->priv->filterBuffer = new uint8_t[info->width * info->height * 3 / 2 + info->height * 2 + info->width * 2];
+
+	if (info->mode == CAPSEO_MODE_DECODE || info->encoded_cursor_fmt == CAPSEO_FORMAT_ENCORE_QLZCARGB)
+		initializeCursorCache(cs);
+
 	cs->priv->encodedBufferLength = info->width * info->height * 4 + QUICKLZ_TAIL_SIZE;
 	cs->priv->encodedBuffer = new uint8_t[cs->priv->encodedBufferLength];
 
@@ -154,6 +239,9 @@ void CapseoFinalize(capseo_t *cs) {
 			break;
 	}
 
+	finalizeSlices(cs);
+	finalizeCursorCache(cs);
+
 	bzero(cs->priv->encodedBuffer, cs->priv->encodedBufferLength);
 	delete[] cs->priv->encodedBuffer;
 	cs->priv->encodedBuffer = 0;
@@ -161,6 +249,11 @@ void CapseoFinalize(capseo_t *cs) {
 	delete[] cs->priv->yuvBuffer;
 	cs->priv->yuvBuffer = 0;
 
+	delete[] cs->priv->deltaBuffer;
+	delete[] cs->priv->referenceBuffer;
+	delete[] cs->priv->filterBuffer;
+	delete[] cs->priv->scaleBuffer;
+
 	bzero(cs->priv, sizeof(*cs->priv));
 	delete cs->priv;
 
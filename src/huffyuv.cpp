@@ -0,0 +1,544 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (HuffYUV style predictive Huffman coding)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo.h"
+#include "capseo_private.h"
+
+#include <string.h>
+#include <algorithm>
+
+/* Each plane is predicted pixel by pixel from its already coded neighbours, and the
+ * prediction residuals get Huffman coded with a table built for that very plane.
+ *
+ * The first row is predicted from the left neighbour, the first column from the pixel
+ * above. Everything else is predicted by the plane's predictor, either from the left
+ * neighbour (L) or by the median of L, the pixel above (T) and the gradient L + T - TL.
+ * The encoder picks whichever of both codes the plane smaller.
+ */
+
+const int MAX_CODE_LENGTH = 15;		//!< longest code, so that code lengths fit into a nibble
+const int LOOKUP_BITS = 12;			//!< index width of the decoder's lookup table
+const int LOOKUP_SYMBOLS = 3;		//!< maximum number of symbols resolved by a single lookup
+
+static inline int median(int a, int b, int c) {
+	return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+/*! \brief computes the residual of pixel \p x (x > 0) of \p row, \p above being the row above it.
+ */
+template<bool AMedian>
+static inline uint8_t residual(const uint8_t *row, const uint8_t *above, int x) {
+	const int left = row[x - 1];
+
+	return AMedian
+		? row[x] - median(left, above[x], left + above[x] - above[x - 1])
+		: row[x] - left;
+}
+
+/*! \brief counts the residuals of both predictors in one pass.
+ */
+static void countResiduals(const uint8_t *APlane, int AWidth, int AHeight, uint32_t ALeft[256], uint32_t AMedian[256]) {
+	// (first row and column are predicted alike)
+	++ALeft[APlane[0]];
+	++AMedian[APlane[0]];
+
+	for (int x = 1; x < AWidth; ++x) {
+		const uint8_t r = APlane[x] - APlane[x - 1];
+		++ALeft[r];
+		++AMedian[r];
+	}
+
+	for (int y = 1; y < AHeight; ++y) {
+		const uint8_t *row = APlane + y * AWidth;
+		const uint8_t *above = row - AWidth;
+
+		const uint8_t r = row[0] - above[0];
+		++ALeft[r];
+		++AMedian[r];
+
+		for (int x = 1; x < AWidth; ++x) {
+			++ALeft[residual<false>(row, above, x)];
+			++AMedian[residual<true>(row, above, x)];
+		}
+	}
+}
+
+/*! \brief reconstructs a plane in place, which holds the residuals on entry.
+ */
+template<bool AMedian>
+static void unpredictPlane(uint8_t *APlane, int AWidth, int AHeight) {
+	for (int x = 1; x < AWidth; ++x)
+		APlane[x] += APlane[x - 1];
+
+	for (int y = 1; y < AHeight; ++y) {
+		uint8_t *row = APlane + y * AWidth;
+		const uint8_t *above = row - AWidth;
+
+		row[0] += above[0];
+
+		for (int x = 1; x < AWidth; ++x) {
+			const int left = row[x - 1];
+
+			row[x] += AMedian ? median(left, above[x], left + above[x] - above[x - 1]) : left;
+		}
+	}
+}
+
+// {{{ code construction
+struct TFrequencyLess {
+	const uint32_t *frequencies;
+
+	bool operator()(int a, int b) const {
+		return frequencies[a] < frequencies[b];
+	}
+};
+
+/*! \brief computes the Huffman code lengths of the given symbol frequencies,
+ *         limited to MAX_CODE_LENGTH bits.
+ *  \return the number of bits coding all symbols takes
+ */
+static uint64_t buildCodeLengths(const uint32_t AFrequencies[256], uint8_t ALengths[256]) {
+	memset(ALengths, 0, 256);
+
+	int symbols[256];
+	int n = 0;
+	for (int s = 0; s < 256; ++s)
+		if (AFrequencies[s])
+			symbols[n++] = s;
+
+	if (n < 2) {
+		// (a lone symbol still needs a code)
+		if (n)
+			ALengths[symbols[0]] = 1;
+
+		return n ? AFrequencies[symbols[0]] : 0;
+	}
+
+	TFrequencyLess less = { AFrequencies };
+	std::stable_sort(symbols, symbols + n, less);
+
+	// merge the two lightest trees, taken from the sorted leaves and the
+	// (ascendingly created) inner nodes, until a single tree is left
+	uint32_t weight[511];
+	int parent[511];
+
+	for (int i = 0; i < n; ++i)
+		weight[i] = AFrequencies[symbols[i]];
+
+	int leaf = 0;
+	int node = n;
+	for (int next = n; next < 2 * n - 1; ++next) {
+		for (int k = 0; k < 2; ++k) {
+			const int lightest = leaf < n && (node == next || weight[leaf] <= weight[node]) ? leaf++ : node++;
+
+			parent[lightest] = next;
+			weight[next] = k ? weight[next] + weight[lightest] : weight[lightest];
+		}
+	}
+
+	// (parents are created after their children, the root being last)
+	int depth[511];
+	depth[2 * n - 2] = 0;
+	for (int i = 2 * n - 3; i >= 0; --i)
+		depth[i] = depth[parent[i]] + 1;
+
+	unsigned kraft = 0;
+	for (int i = 0; i < n; ++i) {
+		ALengths[symbols[i]] = std::min(depth[i], MAX_CODE_LENGTH);
+		kraft += 1U << (MAX_CODE_LENGTH - ALengths[symbols[i]]);
+	}
+
+	// clamping may have oversubscribed the code space, so lengthen the
+	// least frequent of the longest codes still below the limit, until it fits
+	while (kraft > 1U << MAX_CODE_LENGTH) {
+		int longest = -1;
+		for (int i = 0; i < n; ++i)
+			if (ALengths[symbols[i]] < MAX_CODE_LENGTH && (longest < 0 || ALengths[symbols[i]] > ALengths[symbols[longest]]))
+				longest = i;
+
+		kraft -= 1U << (MAX_CODE_LENGTH - ALengths[symbols[longest]] - 1);
+		++ALengths[symbols[longest]];
+	}
+
+	uint64_t bits = 0;
+	for (int i = 0; i < n; ++i)
+		bits += uint64_t(AFrequencies[symbols[i]]) * ALengths[symbols[i]];
+
+	return bits;
+}
+
+/*! \brief assigns canonical codes (ordered by length, then by symbol) to the given code lengths.
+ */
+static void assignCodes(const uint8_t ALengths[256], uint16_t ACodes[256]) {
+	int count[MAX_CODE_LENGTH + 1] = { 0 };
+	for (int s = 0; s < 256; ++s)
+		++count[ALengths[s]];
+
+	unsigned next[MAX_CODE_LENGTH + 1];
+	unsigned code = 0;
+	count[0] = 0;
+	for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+		next[length] = code;
+		code = (code + count[length]) << 1;
+	}
+
+	for (int s = 0; s < 256; ++s)
+		ACodes[s] = ALengths[s] ? next[ALengths[s]]++ : 0;
+}
+// }}}
+
+// {{{ encoding
+/*! MSB first bit writer */
+struct TBitWriter {
+	uint8_t *out;
+	uint64_t bits;			//!< pending bits, the latest being the least significant
+	int count;				//!< number of pending bits
+
+	explicit TBitWriter(uint8_t *AOutput) : out(AOutput), bits(0), count(0) {}
+
+	inline void put(unsigned ACode, int ALength) {
+		bits = (bits << ALength) | ACode;
+		count += ALength;
+
+		if (count >= 32) {
+			count -= 32;
+			const uint32_t word = uint32_t(bits >> count);
+			out[0] = uint8_t(word >> 24);
+			out[1] = uint8_t(word >> 16);
+			out[2] = uint8_t(word >> 8);
+			out[3] = uint8_t(word);
+			out += 4;
+		}
+	}
+
+	/*! writes out the pending bits, zero padded to full bytes */
+	uint8_t *flush() {
+		for (; count >= 8; count -= 8)
+			*out++ = uint8_t(bits >> (count - 8));
+
+		if (count)
+			*out++ = uint8_t(bits << (8 - count));
+
+		count = 0;
+		return out;
+	}
+};
+
+template<bool AMedian>
+static uint8_t *encodePlane(const uint8_t *APlane, int AWidth, int AHeight, const uint16_t ACodes[256], const uint8_t ALengths[256], uint8_t *AOutput) {
+	TBitWriter writer(AOutput);
+
+	writer.put(ACodes[APlane[0]], ALengths[APlane[0]]);
+
+	for (int x = 1; x < AWidth; ++x) {
+		const uint8_t r = APlane[x] - APlane[x - 1];
+		writer.put(ACodes[r], ALengths[r]);
+	}
+
+	for (int y = 1; y < AHeight; ++y) {
+		const uint8_t *row = APlane + y * AWidth;
+		const uint8_t *above = row - AWidth;
+
+		const uint8_t first = row[0] - above[0];
+		writer.put(ACodes[first], ALengths[first]);
+
+		for (int x = 1; x < AWidth; ++x) {
+			const uint8_t r = residual<AMedian>(row, above, x);
+			writer.put(ACodes[r], ALengths[r]);
+		}
+	}
+
+	return writer.flush();
+}
+
+int huffyuvFrameBound(capseo_t *cs) {
+	const int size = videoWidth(cs) * videoHeight(cs);
+
+	// (3 / 2 of the luma plane size, at the longest code each)
+	return 3 * sizeof(TCapseoHuffPlaneHeader) + (size * 3 / 2 * MAX_CODE_LENGTH + 7) / 8 + 3;
+}
+
+/*! \brief encodes a YUV 4:2:0 frame, each plane with its own predictor and code table.
+ *  \return the length of the encoded frame
+ */
+int encodeHuffYUVFrame(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf) {
+	const int width = videoWidth(cs);
+	const int height = videoHeight(cs);
+
+	uint8_t *outptr = outbuf;
+
+	for (int p = 0; p < 3; ++p) {
+		const int w = p ? width / 2 : width;
+		const int h = p ? height / 2 : height;
+		const uint8_t *plane = planeOf(yuv, width, height, p);
+
+		uint32_t leftFrequencies[256] = { 0 };
+		uint32_t medianFrequencies[256] = { 0 };
+		countResiduals(plane, w, h, leftFrequencies, medianFrequencies);
+
+		uint8_t leftLengths[256];
+		uint8_t medianLengths[256];
+		const uint64_t leftBits = buildCodeLengths(leftFrequencies, leftLengths);
+		const uint64_t medianBits = buildCodeLengths(medianFrequencies, medianLengths);
+
+		// (the left predictor decodes faster, so it wins ties)
+		const bool useMedian = medianBits < leftBits;
+		const uint8_t *lengths = useMedian ? medianLengths : leftLengths;
+
+		uint16_t codes[256];
+		assignCodes(lengths, codes);
+
+		TCapseoHuffPlaneHeader *header = (TCapseoHuffPlaneHeader *)outptr;
+		header->predictor = useMedian ? CAPSEO_PREDICT_MEDIAN : CAPSEO_PREDICT_LEFT;
+		for (int s = 0; s < 256; s += 2)
+			header->lengths[s / 2] = lengths[s] | (lengths[s + 1] << 4);
+
+		uint8_t *data = outptr + sizeof(TCapseoHuffPlaneHeader);
+		outptr = useMedian
+			? encodePlane<true>(plane, w, h, codes, lengths, data)
+			: encodePlane<false>(plane, w, h, codes, lengths, data);
+
+		header->length = outptr - data;
+	}
+
+	return outptr - outbuf;
+}
+// }}}
+
+// {{{ decoding
+/*! MSB first bit reader, reading zeros past the end of its input */
+struct TBitReader {
+	const uint8_t *in;
+	const uint8_t *end;
+	uint64_t bits;			//!< buffered bits, the next one being the most significant
+	int count;				//!< number of buffered bits
+
+	TBitReader(const uint8_t *AInput, int ALength) : in(AInput), end(AInput + ALength), bits(0), count(0) {}
+
+	/*! buffers at least 56 bits */
+	inline void refill() {
+		if (end - in >= 8) {
+			uint64_t word = 0;
+			for (int i = 0; i < 8; ++i)
+				word = (word << 8) | in[i];
+
+			// (the partially consumed byte is buffered again next time)
+			bits |= word >> count;
+			in += (63 - count) >> 3;
+			count |= 56;
+		} else {
+			for (; count <= 56; count += 8)
+				bits |= uint64_t(in < end ? *in++ : 0) << (56 - count);
+		}
+	}
+
+	inline unsigned peek(int ACount) const {
+		return unsigned(bits >> (64 - ACount));
+	}
+
+	inline void skip(int ACount) {
+		bits <<= ACount;
+		count -= ACount;
+	}
+};
+
+struct TLookupEntry {
+	uint8_t symbols[LOOKUP_SYMBOLS];
+	uint8_t count;			//!< number of symbols resolved, or 0 if the first code is longer than LOOKUP_BITS
+	uint8_t length;			//!< total length of their codes
+};
+
+/*! canonical Huffman decoding tables */
+struct THuffmanDecoder {
+	unsigned firstCode[MAX_CODE_LENGTH + 1];	//!< first code of each length
+	unsigned count[MAX_CODE_LENGTH + 1];		//!< number of codes of each length
+	unsigned firstIndex[MAX_CODE_LENGTH + 1];	//!< index of the first symbol of each length within \a symbols
+	uint8_t symbols[256];						//!< symbols in canonical order
+
+	TLookupEntry table[1 << LOOKUP_BITS];		//!< symbols starting with a given LOOKUP_BITS bit window
+
+	/*! \retval false the code lengths do not describe a valid code */
+	bool build(const uint8_t APackedLengths[128], int ASymbolCount);
+
+	/*! decodes a single symbol of any length bit by bit, returning -1 on invalid codes */
+	inline int decodeSlow(TBitReader& AReader) const {
+		const unsigned window = AReader.peek(MAX_CODE_LENGTH);
+
+		for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+			const unsigned offset = (window >> (MAX_CODE_LENGTH - length)) - firstCode[length];
+
+			if (offset < count[length]) {
+				AReader.skip(length);
+				return symbols[firstIndex[length] + offset];
+			}
+		}
+
+		return -1;
+	}
+};
+
+bool THuffmanDecoder::build(const uint8_t APackedLengths[128], int ASymbolCount) {
+	uint8_t lengths[256];
+	for (int s = 0; s < 256; s += 2) {
+		lengths[s] = APackedLengths[s / 2] & 0x0F;
+		lengths[s + 1] = APackedLengths[s / 2] >> 4;
+	}
+
+	memset(count, 0, sizeof(count));
+	for (int s = 0; s < 256; ++s)
+		++count[lengths[s]];
+	count[0] = 0;
+
+	unsigned code = 0;
+	unsigned index = 0;
+	unsigned kraft = 0;
+	for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+		firstCode[length] = code;
+		firstIndex[length] = index;
+		code = (code + count[length]) << 1;
+		index += count[length];
+		kraft += count[length] << (MAX_CODE_LENGTH - length);
+	}
+
+	if (kraft > 1U << MAX_CODE_LENGTH || (!index && ASymbolCount))
+		return false;
+
+	for (int length = 1, i = 0; length <= MAX_CODE_LENGTH; ++length)
+		for (int s = 0; s < 256; ++s)
+			if (lengths[s] == length)
+				symbols[i++] = s;
+
+	// first symbol of each window, then as many following symbols as fully fit
+	uint8_t firstSymbol[1 << LOOKUP_BITS];
+	uint8_t firstLength[1 << LOOKUP_BITS];
+	memset(firstLength, 0, sizeof(firstLength));
+
+	for (int length = 1; length <= LOOKUP_BITS; ++length) {
+		for (unsigned k = 0; k < count[length]; ++k) {
+			const unsigned first = (firstCode[length] + k) << (LOOKUP_BITS - length);
+			const unsigned last = first + (1U << (LOOKUP_BITS - length));
+
+			for (unsigned window = first; window < last; ++window) {
+				firstSymbol[window] = symbols[firstIndex[length] + k];
+				firstLength[window] = length;
+			}
+		}
+	}
+
+	for (unsigned window = 0; window < 1U << LOOKUP_BITS; ++window) {
+		TLookupEntry& entry = table[window];
+		entry.count = 0;
+		entry.length = 0;
+
+		while (entry.count < LOOKUP_SYMBOLS) {
+			// (the remaining bits, zero padded)
+			const unsigned rest = (window << entry.length) & ((1U << LOOKUP_BITS) - 1);
+			const int length = firstLength[rest];
+
+			if (!length || length > LOOKUP_BITS - entry.length)
+				break;
+
+			entry.symbols[entry.count++] = firstSymbol[rest];
+			entry.length += length;
+		}
+	}
+
+	return true;
+}
+
+/*! \brief decodes \p ASize residuals into \p AOutput.
+ *  \retval false invalid codes were encountered
+ */
+static bool decodeResiduals(const THuffmanDecoder& ADecoder, TBitReader& AReader, uint8_t *AOutput, int ASize) {
+	int i = 0;
+
+	// (a refill lasts for three lookups, each resolving up to LOOKUP_SYMBOLS symbols)
+	while (i + 3 * LOOKUP_SYMBOLS <= ASize) {
+		AReader.refill();
+
+		for (int k = 0; k < 3; ++k) {
+			const TLookupEntry& entry = ADecoder.table[AReader.peek(LOOKUP_BITS)];
+
+			if (entry.count) {
+				memcpy(AOutput + i, entry.symbols, LOOKUP_SYMBOLS);
+				i += entry.count;
+				AReader.skip(entry.length);
+			} else {
+				const int symbol = ADecoder.decodeSlow(AReader);
+				if (symbol < 0)
+					return false;
+
+				AOutput[i++] = symbol;
+			}
+		}
+	}
+
+	while (i < ASize) {
+		AReader.refill();
+
+		const int symbol = ADecoder.decodeSlow(AReader);
+		if (symbol < 0)
+			return false;
+
+		AOutput[i++] = symbol;
+	}
+
+	return true;
+}
+
+/*! \brief decodes a HuffYUV frame, or just its luma plane when decoding into CAPSEO_FORMAT_Y8.
+ */
+int decodeHuffYUVFrame(capseo_t *cs, uint8_t *inbuf, int inlen, uint8_t *yuv) {
+	const int width = videoWidth(cs);
+	const int height = videoHeight(cs);
+	const int planes = cs->info.format == CAPSEO_FORMAT_Y8 ? 1 : 3;
+
+	const uint8_t *inptr = inbuf;
+	const uint8_t *inend = inbuf + inlen;
+
+	THuffmanDecoder decoder;
+
+	for (int p = 0; p < planes; ++p) {
+		const int w = p ? width / 2 : width;
+		const int h = p ? height / 2 : height;
+		uint8_t *plane = planeOf(yuv, width, height, p);
+
+		if (inend - inptr < int(sizeof(TCapseoHuffPlaneHeader)))
+			return CAPSEO_E_INVALID_HEADER;
+
+		const TCapseoHuffPlaneHeader *header = (const TCapseoHuffPlaneHeader *)inptr;
+		inptr += sizeof(TCapseoHuffPlaneHeader);
+
+		if (header->length > uint32_t(inend - inptr) || header->predictor > CAPSEO_PREDICT_MEDIAN)
+			return CAPSEO_E_INVALID_HEADER;
+
+		if (!decoder.build(header->lengths, w * h))
+			return CAPSEO_E_INVALID_HEADER;
+
+		TBitReader reader(inptr, header->length);
+		if (!decodeResiduals(decoder, reader, plane, w * h))
+			return CAPSEO_E_INVALID_HEADER;
+
+		if (header->predictor == CAPSEO_PREDICT_MEDIAN)
+			unpredictPlane<true>(plane, w, h);
+		else
+			unpredictPlane<false>(plane, w, h);
+
+		inptr += header->length;
+	}
+
+	return CAPSEO_SUCCESS;
+}
+// }}}
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,386 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (stream frame index and seeking)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#define _LARGEFILE64_SOURCE (1)
+
+#include "capseo.h"
+#include "capseo_private.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*! \brief tests whether the given encoded frame can be decoded without its predecessors.
+ */
+static bool isKeyframe(int AFormat, const uint8_t *AFrame) {
+	const TCapseoFrameHeader *header = (const TCapseoFrameHeader *)AFrame;
+	const TCapseoVideoHeader *video = (const TCapseoVideoHeader *)(AFrame + sizeof(*header));
+
+	// (repeated frames depend on their predecessor, whatever the format)
+	if (!header->video.length)
+		return false;
+
+	switch (AFormat) {
+		case CAPSEO_FORMAT_ENCORE_QLZDYUV420:
+		case CAPSEO_FORMAT_ENCORE_QLZTYUV420:
+			return video->type == CAPSEO_FRAME_KEY;
+		default:
+			return true;
+	}
+}
+
+/*! \brief tests whether the stream's cursor records refer to cached shapes.
+ */
+static inline bool cachesCursors(const capseo_stream_t *stream) {
+	return stream->frameHandle.info.encoded_cursor_fmt == CAPSEO_FORMAT_ENCORE_QLZCARGB;
+}
+
+/*! \brief appends an index entry for the given encoded frame, to be written at the current stream offset.
+ *  \param ACursor the frame's cursor record header, in case of a cached cursor format (or NULL)
+ */
+static void appendEntry(capseo_stream_t *stream, const uint8_t *AFrame, const TCapseoCursorHeader *ACursor, uint64_t AOffset) {
+	if (stream->indexCount == stream->indexCapacity) {
+		const uint64_t capacity = stream->indexCapacity ? stream->indexCapacity * 2 : 1024;
+
+		TCapseoIndexEntry *index = new TCapseoIndexEntry[capacity];
+		memcpy(index, stream->index, stream->indexCount * sizeof(TCapseoIndexEntry));
+
+		delete[] stream->index;
+		stream->index = index;
+		stream->indexCapacity = capacity;
+	}
+
+	const TCapseoFrameHeader *header = (const TCapseoFrameHeader *)AFrame;
+
+	TCapseoIndexEntry *entry = &stream->index[stream->indexCount++];
+	entry->id = header->id;
+	entry->offset = AOffset;
+	entry->flags = 0;
+
+	if (isKeyframe(stream->frameHandle.info.encoded_video_fmt, AFrame))
+		entry->flags |= CAPSEO_INDEX_KEYFRAME;
+
+	if (header->cursor.length)
+		entry->flags |= CAPSEO_INDEX_CURSOR;
+
+	if (ACursor && ACursor->type == CAPSEO_CURSOR_SHAPE && ACursor->slot < CAPSEO_CURSOR_SLOTS)
+		entry->flags |= CAPSEO_INDEX_CURSOR_SHAPE | (ACursor->slot << 4);
+}
+
+/*! \brief records the encoded frame about to be written at the current stream offset, if indexing.
+ */
+void appendStreamIndex(capseo_stream_t *stream, const uint8_t *encodedFrame) {
+	if (!stream->frameHandle.info.write_index)
+		return;
+
+	const TCapseoFrameHeader *header = (const TCapseoFrameHeader *)encodedFrame;
+	const TCapseoCursorHeader *cursor = 0;
+
+	if (cachesCursors(stream) && header->cursor.length)
+		cursor = (const TCapseoCursorHeader *)(encodedFrame + sizeof(*header) + header->video.length);
+
+	appendEntry(stream, encodedFrame, cursor, stream->streamOffset);
+}
+
+static bool writeAll(int fd, const void *buffer, size_t length) {
+	for (const uint8_t *p = (const uint8_t *)buffer; length; ) {
+		ssize_t nwritten = write(fd, p, length);
+		if (nwritten <= 0)
+			return false;
+
+		p += nwritten;
+		length -= nwritten;
+	}
+	return true;
+}
+
+/*! \brief terminates the frame sequence of the encoding stream and appends its index, if indexing.
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_SYSTEM write error
+ */
+int writeStreamIndex(capseo_stream_t *stream) {
+	if (!stream->frameHandle.info.write_index)
+		return CAPSEO_SUCCESS;
+
+	const uint32_t sentinel = CAPSEO_INDEX_SENTINEL;
+
+	TCapseoIndexTrailer trailer;
+	trailer.offset = stream->streamOffset;
+	trailer.count = stream->indexCount;
+	trailer.magic[0] = 'C';
+	trailer.magic[1] = 'P';
+	trailer.magic[2] = 'S';
+	trailer.magic[3] = 'I';
+
+	if (!writeAll(stream->fd, &sentinel, sizeof(sentinel))
+			|| !writeAll(stream->fd, stream->index, stream->indexCount * sizeof(TCapseoIndexEntry))
+			|| !writeAll(stream->fd, &trailer, sizeof(trailer)))
+		return CAPSEO_E_SYSTEM;
+
+	return CAPSEO_SUCCESS;
+}
+
+void destroyStreamIndex(capseo_stream_t *stream) {
+	delete[] stream->index;
+	stream->index = 0;
+	stream->indexCount = 0;
+	stream->indexCapacity = 0;
+}
+
+/*! \brief reads \p ALength bytes at \p AOffset (relative to the stream header) of a decoding stream.
+ */
+static bool readAt(capseo_stream_t *stream, void *ABuffer, size_t ALength, uint64_t AOffset) {
+	const uint64_t offset = stream->streamBase + AOffset;
+
+	if (stream->map) {
+		if (offset > stream->mapLength || ALength > stream->mapLength - offset)
+			return false;
+
+		memcpy(ABuffer, stream->map + offset, ALength);
+		return true;
+	}
+
+	return pread(stream->fd, ABuffer, ALength, offset) == ssize_t(ALength);
+}
+
+/*! \brief loads the trailing index of the decoding stream, if it has a valid one.
+ */
+static bool loadTrailingIndex(capseo_stream_t *stream, uint64_t AStreamLength) {
+	TCapseoIndexTrailer trailer;
+	if (AStreamLength < sizeof(trailer) || !readAt(stream, &trailer, sizeof(trailer), AStreamLength - sizeof(trailer)))
+		return false;
+
+	if (trailer.magic[0] != 'C' || trailer.magic[1] != 'P' || trailer.magic[2] != 'S' || trailer.magic[3] != 'I')
+		return false;
+
+	// the index must exactly fill the space between sentinel and trailer
+	const uint64_t length = AStreamLength - sizeof(trailer) - sizeof(uint32_t);
+	if (trailer.offset > length || trailer.count != (length - trailer.offset) / sizeof(TCapseoIndexEntry)
+			|| trailer.count * sizeof(TCapseoIndexEntry) != length - trailer.offset)
+		return false;
+
+	uint32_t sentinel;
+	if (!readAt(stream, &sentinel, sizeof(sentinel), trailer.offset) || sentinel != CAPSEO_INDEX_SENTINEL)
+		return false;
+
+	TCapseoIndexEntry *index = new TCapseoIndexEntry[trailer.count ? trailer.count : 1];
+	if (!readAt(stream, index, trailer.count * sizeof(TCapseoIndexEntry), trailer.offset + sizeof(sentinel))) {
+		delete[] index;
+		return false;
+	}
+
+	stream->index = index;
+	stream->indexCount = stream->indexCapacity = trailer.count;
+
+	return true;
+}
+
+/*! \brief rebuilds the index of the decoding stream by just reading the frame headers.
+ *
+ *  Only the frame lengths, frame headers, video type bytes and cursor record
+ *  headers are read, the payloads in between are skipped.
+ */
+static void rebuildIndex(capseo_stream_t *stream) {
+	uint8_t frame[sizeof(TCapseoFrameHeader) + sizeof(TCapseoVideoHeader)];
+	const TCapseoFrameHeader *header = (const TCapseoFrameHeader *)frame;
+	TCapseoCursorHeader cursor;
+	uint32_t frameLength;
+
+	for (uint64_t offset = stream->headerLength; ; offset += sizeof(frameLength) + frameLength) {
+		if (!readAt(stream, &frameLength, sizeof(frameLength), offset) || frameLength == CAPSEO_INDEX_SENTINEL)
+			break;
+
+		if (frameLength < sizeof(TCapseoFrameHeader) || !readAt(stream, frame, sizeof(TCapseoFrameHeader), offset + sizeof(frameLength)))
+			break;
+
+		// (the type byte is only present for non-empty payloads)
+		if (frameLength > sizeof(TCapseoFrameHeader))
+			readAt(stream, frame + sizeof(TCapseoFrameHeader), sizeof(TCapseoVideoHeader), offset + sizeof(frameLength) + sizeof(TCapseoFrameHeader));
+
+		const bool hasCursor = cachesCursors(stream) && header->cursor.length >= int(sizeof(cursor))
+			&& readAt(stream, &cursor, sizeof(cursor), offset + sizeof(frameLength) + sizeof(TCapseoFrameHeader) + header->video.length);
+
+		appendEntry(stream, frame, hasCursor ? &cursor : 0, offset);
+	}
+}
+
+/*! \brief loads (or rebuilds) the index of the decoding stream, once.
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_NOT_SUPPORTED the stream is not seekable
+ */
+static int loadStreamIndex(capseo_stream_t *stream) {
+	if (stream->indexLoaded)
+		return CAPSEO_SUCCESS;
+
+	struct stat st;
+	if (fstat(stream->fd, &st) == -1 || !S_ISREG(st.st_mode) || uint64_t(st.st_size) < stream->streamBase)
+		return CAPSEO_E_NOT_SUPPORTED;
+
+	if (!loadTrailingIndex(stream, st.st_size - stream->streamBase))
+		rebuildIndex(stream);
+
+	stream->indexLoaded = true;
+
+	return CAPSEO_SUCCESS;
+}
+
+/*! \brief positions the decoding stream at the frame record at \p AOffset.
+ */
+static int setStreamOffset(capseo_stream_t *stream, uint64_t AOffset) {
+	if (stream->map) {
+		// (readahead restarts at the new position, rather than covering what has been skipped)
+		stream->mapOffset = stream->streamBase + AOffset;
+		stream->mapAdvised = stream->mapOffset;
+		return CAPSEO_SUCCESS;
+	}
+
+	if (lseek64(stream->fd, stream->streamBase + AOffset, SEEK_SET) == -1)
+		return CAPSEO_E_SYSTEM;
+
+	return CAPSEO_SUCCESS;
+}
+
+/*! \brief finds the frames last storing each cached cursor shape before the given index entry.
+ *  \param AEnd the index entry to search backwards from (exclusively)
+ *  \param AFrames the index entries found will be stored here, in descending order
+ *  \return the number of index entries found
+ */
+static int collectCursorShapes(capseo_stream_t *stream, uint64_t AEnd, uint64_t AFrames[CAPSEO_CURSOR_SLOTS]) {
+	bool seen[CAPSEO_CURSOR_SLOTS] = { false };
+	int count = 0;
+
+	for (uint64_t i = AEnd; i > 0 && count < CAPSEO_CURSOR_SLOTS; ) {
+		const uint8_t flags = stream->index[--i].flags;
+
+		if ((flags & CAPSEO_INDEX_CURSOR_SHAPE) && !seen[CAPSEO_INDEX_CURSOR_SLOT(flags)]) {
+			seen[CAPSEO_INDEX_CURSOR_SLOT(flags)] = true;
+			AFrames[count++] = i;
+		}
+	}
+
+	return count;
+}
+
+/*! \brief seeks the decoding stream to the given frame.
+ *  \param stream the decoding stream
+ *  \param id the frame ID to seek to
+ *  \retval CAPSEO_SUCCESS success, the next decoded frame will be the last one with an ID not after \p id
+ *                         (or the first frame, if \p id lies before it)
+ *  \retval CAPSEO_E_INVALID_ARGUMENT not a decoding stream
+ *  \retval CAPSEO_E_NOT_SUPPORTED the stream is not seekable (e.g. a pipe)
+ *  \retval CAPSEO_STREAM_END the stream contains no frames
+ *  \return or any error returned by CapseoStreamDecodeFrame()
+ *
+ *  The stream's index is used if present, otherwise it is rebuilt from the frame headers
+ *  on first use. For delta formats, decoding restarts at the preceding keyframe, and
+ *  the frames in between are decoded silently. As the cursor shape is only stored
+ *  when it changes, the last frame carrying one is decoded first, if it lies before.
+ *  For cached cursor formats, so are the frames last storing each cached shape.
+ *  Decoding ahead resumes from the frame sought to.
+ */
+int CapseoStreamSeek(capseo_stream_t *stream, capseo_frame_id_t id) {
+	if (stream->frameHandle.info.mode != CAPSEO_MODE_DECODE)
+		return CAPSEO_E_INVALID_ARGUMENT;
+
+	if (int error = loadStreamIndex(stream))
+		return error;
+
+	if (!stream->indexCount)
+		return CAPSEO_STREAM_END;
+
+	// (frames decoded ahead are dropped, the ones held by the caller stay valid)
+	if (stream->ahead)
+		stopDecodeAhead(stream);
+
+	// find the last frame not after id (frame IDs are increasing)
+	uint64_t low = 0, high = stream->indexCount;
+	while (low < high) {
+		const uint64_t middle = low + (high - low) / 2;
+		if (stream->index[middle].id <= id)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	const uint64_t target = low ? low - 1 : 0;
+
+	uint64_t key = target;
+	while (key > 0 && !(stream->index[key].flags & CAPSEO_INDEX_KEYFRAME))
+		--key;
+
+	uint64_t shape = key;
+	while (shape > 0 && !(stream->index[shape].flags & CAPSEO_INDEX_CURSOR))
+		--shape;
+
+	capseo_frame_t *frame;
+
+	// (their video is garbage for delta formats, but the keyframe decoded next replaces it)
+	uint64_t cached[CAPSEO_CURSOR_SLOTS];
+	for (int i = collectCursorShapes(stream, shape, cached) - 1; i >= 0; --i) {
+		if (int error = setStreamOffset(stream, stream->index[cached[i]].offset))
+			return error;
+
+		if (int error = decodeStreamFrame(stream, &frame, false))
+			return error;
+	}
+
+	if (shape < key && (stream->index[shape].flags & CAPSEO_INDEX_CURSOR)) {
+		if (int error = setStreamOffset(stream, stream->index[shape].offset))
+			return error;
+
+		if (int error = decodeStreamFrame(stream, &frame, false))
+			return error;
+	}
+
+	if (int error = setStreamOffset(stream, stream->index[key].offset))
+		return error;
+
+	for (uint64_t i = key; i < target; ++i) {
+		if (int error = decodeStreamFrame(stream, &frame, false))
+			return error;
+	}
+
+	return CAPSEO_SUCCESS;
+}
+
+/*! \brief retrieves the time span and number of frames of the decoding stream.
+ *  \param stream the decoding stream
+ *  \param first the first frame's ID will be stored here (may be NULL)
+ *  \param last the last frame's ID will be stored here (may be NULL)
+ *  \param frames the number of frames will be stored here (may be NULL)
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_INVALID_ARGUMENT not a decoding stream
+ *  \retval CAPSEO_E_NOT_SUPPORTED the stream is not seekable (e.g. a pipe)
+ */
+int CapseoStreamGetDuration(capseo_stream_t *stream, capseo_frame_id_t *first, capseo_frame_id_t *last, uint64_t *frames) {
+	if (stream->frameHandle.info.mode != CAPSEO_MODE_DECODE)
+		return CAPSEO_E_INVALID_ARGUMENT;
+
+	if (int error = loadStreamIndex(stream))
+		return error;
+
+	const uint64_t count = stream->indexCount;
+
+	if (first)
+		*first = count ? stream->index[0].id : 0;
+
+	if (last)
+		*last = count ? stream->index[count - 1].id : 0;
+
+	if (frames)
+		*frames = count;
+
+	return CAPSEO_SUCCESS;
+}
+
+// vim:ai:noet:ts=4:nowrap
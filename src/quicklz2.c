@@ -0,0 +1,17 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (QuickLZ at compression level 2)
+//
+//  Authors:
+//      Copyright (c) 2007-2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#define QLZ_COMPRESSION_LEVEL 2
+#include "quicklz_variant.h"
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,35 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (builds QuickLZ at a given compression level, side by side with other levels)
+//
+//  Authors:
+//      Copyright (c) 2007-2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#ifndef QLZ_COMPRESSION_LEVEL
+# error QLZ_COMPRESSION_LEVEL must be defined before including quicklz_variant.h
+#endif
+
+/* The public QuickLZ functions are prefixed by qlz<level>_, e.g. qlz2_compress(),
+ * and the level's scratch sizes are exported as qlz<level>_scratch_(de)compress.
+ */
+#define QLZ_VARIANT_(level, name) qlz##level##_##name
+#define QLZ_VARIANT(level, name) QLZ_VARIANT_(level, name)
+
+#define qlz_get_setting			QLZ_VARIANT(QLZ_COMPRESSION_LEVEL, get_setting)
+#define qlz_size_decompressed	QLZ_VARIANT(QLZ_COMPRESSION_LEVEL, size_decompressed)
+#define qlz_size_compressed		QLZ_VARIANT(QLZ_COMPRESSION_LEVEL, size_compressed)
+#define qlz_compress			QLZ_VARIANT(QLZ_COMPRESSION_LEVEL, compress)
+#define qlz_decompress			QLZ_VARIANT(QLZ_COMPRESSION_LEVEL, decompress)
+
+#include "quicklz.c"
+
+const size_t QLZ_VARIANT(QLZ_COMPRESSION_LEVEL, scratch_compress) = QLZ_SCRATCH_COMPRESS;
+const size_t QLZ_VARIANT(QLZ_COMPRESSION_LEVEL, scratch_decompress) = QLZ_SCRATCH_DECOMPRESS;
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,259 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (multi-threaded sliced frame coding)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "capseo.h"
+#include "capseo_private.h"
+#include "compress.h"
+#include "workers.h"
+
+#include <string.h>
+
+const int MAX_SLICES = 255;		//!< slice count must fit into a single byte
+
+struct TSliceJob {
+	void *compressor;		//!< the slice's own (de)compressor scratch
+	uint8_t *input;
+	int inputLength;
+	uint8_t *output;
+	int outputLength;
+};
+
+static void compressSlice(void *AJob) {
+	TSliceJob *job = (TSliceJob *)AJob;
+	job->outputLength = Compress(job->compressor, job->input, job->inputLength, job->output);
+}
+
+static void decompressSlice(void *AJob) {
+	TSliceJob *job = (TSliceJob *)AJob;
+	job->outputLength = Decompress(job->compressor, job->input, job->output);
+}
+
+/*! \brief ensures there are at least \p ACount slice (de)compressors available.
+ */
+static void requireSliceCompressors(capseo_t *cs, int ACount) {
+	capseo_private_t *priv = cs->priv;
+
+	if (ACount <= priv->sliceCompressorCount)
+		return;
+
+	void **compressors = new void *[ACount];
+	for (int i = 0; i < priv->sliceCompressorCount; ++i)
+		compressors[i] = priv->sliceCompressors[i];
+
+	for (int i = priv->sliceCompressorCount; i < ACount; ++i)
+		compressors[i] = cs->info.mode == CAPSEO_MODE_ENCODE
+			? CompressorCreate(cs->info.compression, cs->info.compression_level)
+			: DecompressorCreate(cs->info.compression, cs->info.compression_level);
+
+	delete[] priv->sliceCompressors;
+	priv->sliceCompressors = compressors;
+	priv->sliceCompressorCount = ACount;
+}
+
+/*! \brief runs the given slice jobs on the handle's worker pool.
+ */
+static void runSliceJobs(capseo_t *cs, TWorkerJob AJob, TSliceJob *AJobs, int ACount) {
+	void *arguments[MAX_SLICES];
+	for (int i = 0; i < ACount; ++i)
+		arguments[i] = &AJobs[i];
+
+	WorkerPoolRun(cs->priv->workers, AJob, arguments, ACount);
+}
+
+/*! \brief initializes sliced (de)compression support for the given handle.
+ *
+ *  The encoder splits each frame into one slice per worker thread, or into
+ *  one slice per plane for CAPSEO_FORMAT_ENCORE_QLZPYUV420.
+ */
+void initializeSlices(capseo_t *cs) {
+	int threads = WorkerCount(cs->info.threads);
+
+	if (cs->info.encoded_video_fmt == CAPSEO_FORMAT_ENCORE_QLZPYUV420) {
+		cs->priv->sliceCount = 3;
+		threads = threads < 3 ? threads : 3;
+	} else {
+		cs->priv->sliceCount = threads < MAX_SLICES ? threads : MAX_SLICES;
+	}
+
+	cs->priv->workers = WorkerPoolCreate(threads);
+
+	if (cs->info.mode == CAPSEO_MODE_ENCODE)
+		requireSliceCompressors(cs, cs->priv->sliceCount);
+}
+
+void finalizeSlices(capseo_t *cs) {
+	capseo_private_t *priv = cs->priv;
+
+	for (int i = 0; i < priv->sliceCompressorCount; ++i) {
+		if (cs->info.mode == CAPSEO_MODE_ENCODE)
+			CompressorDestroy(priv->sliceCompressors[i]);
+		else
+			DecompressorDestroy(priv->sliceCompressors[i]);
+	}
+
+	delete[] priv->sliceCompressors;
+	priv->sliceCompressors = 0;
+	priv->sliceCompressorCount = 0;
+
+	if (priv->workers) {
+		WorkerPoolDestroy(priv->workers);
+		priv->workers = 0;
+	}
+}
+
+/*! \brief computes the end offset of slice \p AIndex, out of \p ACount slices of a frame.
+ *
+ *  Slices of CAPSEO_FORMAT_ENCORE_QLZPYUV420 are the Y, U and V planes.
+ */
+static inline int sliceEnd(capseo_t *cs, int ACount, int AIndex) {
+	const int lumaSize = videoWidth(cs) * videoHeight(cs);
+	const int size = lumaSize * 3 / 2;
+
+	if (cs->info.encoded_video_fmt == CAPSEO_FORMAT_ENCORE_QLZPYUV420)
+		return lumaSize + lumaSize / 4 * AIndex;
+
+	return AIndex == ACount - 1 ? size : size / ACount * (AIndex + 1);
+}
+
+/*! \brief computes the maximum video payload length encodeSliceFrame() may produce.
+ */
+int sliceFrameBound(capseo_t *cs) {
+	const int count = cs->priv->sliceCount;
+
+	int bound = sizeof(TCapseoVideoHeader) + 1 + count * sizeof(TCapseoSliceHeader);
+	for (int i = 0, offset = 0, next; i < count; ++i, offset = next) {
+		next = sliceEnd(cs, count, i);
+		bound += CompressBound(cs->priv->compressor, next - offset);
+	}
+
+	return bound;
+}
+
+/*! \brief encodes a video frame of format CAPSEO_FORMAT_ENCORE_QLZSYUV420 or CAPSEO_FORMAT_ENCORE_QLZPYUV420.
+ *  \param cs the encoder handle
+ *  \param yuv the YUV 4:2:0 frame to encode
+ *  \param outbuf the buffer to store the encoded video payload into
+ *  \return the encoded video payload length
+ *
+ *  The frame is split into independent horizontal slices (or into its planes), that are compressed
+ *  in parallel. The payload consists of the slice count, followed by the slice table
+ *  and the compressed slices in order.
+ */
+int encodeSliceFrame(capseo_t *cs, uint8_t *yuv, uint8_t *outbuf) {
+	const int count = cs->priv->sliceCount;
+
+	TCapseoVideoHeader *header = (TCapseoVideoHeader *)outbuf;
+	header->type = CAPSEO_FRAME_KEY;
+
+	uint8_t *sliceCount = outbuf + sizeof(*header);
+	*sliceCount = count;
+
+	TCapseoSliceHeader *table = (TCapseoSliceHeader *)(sliceCount + 1);
+	uint8_t *outptr = (uint8_t *)(table + count);
+
+	// compress each slice into its worst case location
+	TSliceJob jobs[MAX_SLICES];
+	for (int i = 0, offset = 0, next; i < count; ++i, offset = next) {
+		next = sliceEnd(cs, count, i);
+
+		jobs[i].compressor = cs->priv->sliceCompressors[i];
+		jobs[i].input = yuv + offset;
+		jobs[i].inputLength = next - offset;
+		jobs[i].output = i ? jobs[i - 1].output + CompressBound(jobs[i - 1].compressor, jobs[i - 1].inputLength) : outptr;
+	}
+
+	runSliceJobs(cs, &compressSlice, jobs, count);
+
+	// then pack them together
+	for (int i = 0; i < count; ++i) {
+		table[i].rawLength = jobs[i].inputLength;
+		table[i].length = jobs[i].outputLength;
+
+		if (outptr != jobs[i].output)
+			memmove(outptr, jobs[i].output, jobs[i].outputLength);
+
+		outptr += jobs[i].outputLength;
+	}
+
+	return outptr - outbuf;
+}
+
+/*! \brief decodes a video frame of format CAPSEO_FORMAT_ENCORE_QLZSYUV420 or CAPSEO_FORMAT_ENCORE_QLZPYUV420.
+ *  \param cs the decoder handle
+ *  \param inbuf the encoded video payload
+ *  \param inlen the encoded video payload length
+ *  \param yuv the buffer to store the decoded YUV 4:2:0 frame into
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_INVALID_HEADER corrupt slice table or slice data
+ *
+ *  Decoding into CAPSEO_FORMAT_Y8 skips the slices holding nothing but chroma.
+ */
+int decodeSliceFrame(capseo_t *cs, uint8_t *inbuf, int inlen, uint8_t *yuv) {
+	const int lumaSize = videoWidth(cs) * videoHeight(cs);
+	const int size = lumaSize * 3 / 2;
+
+	TCapseoVideoHeader *header = (TCapseoVideoHeader *)inbuf;
+	if (inlen < int(sizeof(*header) + 1) || header->type != CAPSEO_FRAME_KEY)
+		return CAPSEO_E_INVALID_HEADER;
+
+	const int count = *(inbuf + sizeof(*header));
+	const TCapseoSliceHeader *table = (const TCapseoSliceHeader *)(inbuf + sizeof(*header) + 1);
+	const int tableLength = sizeof(*header) + 1 + count * sizeof(TCapseoSliceHeader);
+
+	if (inlen < tableLength)
+		return CAPSEO_E_INVALID_HEADER;
+
+	// the slices must exactly cover the payload and the decoded frame
+	uint64_t encodedLength = tableLength;
+	uint64_t decodedLength = 0;
+	for (int i = 0; i < count; ++i) {
+		encodedLength += table[i].length;
+		decodedLength += table[i].rawLength;
+	}
+
+	if (encodedLength != uint64_t(inlen) || decodedLength != uint64_t(size))
+		return CAPSEO_E_INVALID_HEADER;
+
+	requireSliceCompressors(cs, count);
+
+	uint8_t *inptr = inbuf + tableLength;
+	TSliceJob jobs[MAX_SLICES];
+	int offset = 0;
+	int needed = count;
+	for (int i = 0; i < count; ++i) {
+		jobs[i].compressor = cs->priv->sliceCompressors[i];
+		jobs[i].input = inptr;
+		jobs[i].inputLength = table[i].length;
+		jobs[i].output = yuv + offset;
+
+		// (each slice must decompress into its own place only)
+		if (DecompressedSize(jobs[i].compressor, jobs[i].input, jobs[i].inputLength) != int(table[i].rawLength))
+			return CAPSEO_E_INVALID_HEADER;
+
+		if (cs->info.format == CAPSEO_FORMAT_Y8 && offset >= lumaSize && needed == count)
+			needed = i;
+
+		inptr += table[i].length;
+		offset += table[i].rawLength;
+	}
+
+	runSliceJobs(cs, &decompressSlice, jobs, needed);
+
+	for (int i = 0; i < needed; ++i)
+		if (jobs[i].outputLength != int(table[i].rawLength))
+			return CAPSEO_E_INVALID_HEADER;
+
+	return CAPSEO_SUCCESS;
+}
+
+// vim:ai:noet:ts=4:nowrap
@@ -19,14 +19,22 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+const size_t READAHEAD_WINDOW = 8 * 1024 * 1024;	//!< mapped decoder streams: readahead request granularity
+
 template<typename T>
 inline T max(const T& a, const T& b) {
 	return a > b ? a : b;
 }
 
+template<typename T>
+inline T min(const T& a, const T& b) {
+	return a < b ? a : b;
+}
+
 inline int CreateEncoderStream(capseo_info_t *info, int fd, capseo_stream_t **stream) {
 	capseo_t cs;
 	if (int error = CapseoInitialize(&cs, info))
@@ -36,6 +44,8 @@ inline int CreateEncoderStream(capseo_info_t *info, int fd, capseo_stream_t **st
 	bzero(*stream, sizeof(**stream));
 	(*stream)->frameHandle = cs;
 	(*stream)->fd = fd;
+	(*stream)->headerLength = sizeof(TCapseoStreamHeader);
+	(*stream)->streamOffset = (*stream)->headerLength;
 
 	{	// encode stream header
 		uint8_t *buffer;
@@ -62,16 +72,80 @@ inline int CreateEncoderStream(capseo_info_t *info, int fd, capseo_stream_t **st
 
 	(*stream)->encodedHeader = new uint8_t[max(sizeof(TCapseoStreamHeader), sizeof(TCapseoFrameHeader))];
 
+	if (info->async_frames > 0) {
+		if (int error = createAsyncEncoder(*stream, info->async_frames)) {
+			CapseoStreamDestroy(*stream);
+			*stream = 0;
+
+			return error;
+		}
+	}
+
 	return CAPSEO_SUCCESS;
 }
 
+/*! \brief requests readahead of the next window of the mapped stream file, once needed.
+ */
+static inline void adviseReadahead(capseo_stream_t *stream) {
+	if (stream->mapOffset + READAHEAD_WINDOW / 2 < stream->mapAdvised || stream->mapAdvised >= stream->mapLength)
+		return;
+
+	const size_t pageSize = sysconf(_SC_PAGESIZE);
+	const size_t begin = stream->mapAdvised & ~(pageSize - 1);
+	const size_t end = min(stream->mapOffset + READAHEAD_WINDOW, stream->mapLength);
+
+	madvise(stream->map + begin, end - begin, MADV_WILLNEED);
+	stream->mapAdvised = end;
+}
+
+/*! \brief maps the stream file to be decoded, if possible.
+ *  \retval true the file is mapped, the next frame is to be read from stream->mapOffset
+ *  \retval false the file could not be mapped (e.g. is a pipe), so read() must be used
+ */
+static bool mapDecoderStream(capseo_stream_t *stream) {
+	struct stat st;
+	if (fstat(stream->fd, &st) == -1 || !S_ISREG(st.st_mode) || off_t(size_t(st.st_size)) != st.st_size)
+		return false;
+
+	off_t offset = lseek(stream->fd, 0, SEEK_CUR);
+	if (offset == -1 || offset > st.st_size)
+		return false;
+
+	void *map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, stream->fd, 0);
+	if (map == MAP_FAILED)
+		return false;
+
+	// we walk the file front to back, so let the kernel read ahead aggressively
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	stream->map = (uint8_t *)map;
+	stream->mapLength = st.st_size;
+	stream->mapOffset = offset;
+	stream->mapAdvised = offset;
+
+	adviseReadahead(stream);
+
+	return true;
+}
+
 inline int CreateDecoderStream(capseo_info_t *info, int fd, capseo_stream_t **stream) {
 	uint8_t encodedHeader[sizeof(TCapseoStreamHeader)];
 
-	if (read(fd, &encodedHeader, sizeof(encodedHeader)) != sizeof(encodedHeader))
+	// (frame index offsets are relative to the stream header, which need not start the file)
+	off_t streamBase = lseek(fd, 0, SEEK_CUR);
+	if (streamBase == -1)
+		streamBase = 0;
+
+	// (the header's length depends on its revision)
+	const int v1Length = CAPSEO_STREAM_HEADER_V1_LENGTH;
+	if (read(fd, &encodedHeader, v1Length) != v1Length)
+		return CAPSEO_E_SYSTEM;
+
+	const int headerLength = streamHeaderLength(encodedHeader[3]);
+	if (headerLength > v1Length && read(fd, encodedHeader + v1Length, headerLength - v1Length) != headerLength - v1Length)
 		return CAPSEO_E_SYSTEM;
 
-	if (int error = CapseoDecodeStreamHeader(encodedHeader, sizeof(encodedHeader), info))
+	if (int error = CapseoDecodeStreamHeader(encodedHeader, headerLength, info))
 		return error;
 
 	capseo_t cs;
@@ -85,7 +159,14 @@ inline int CreateDecoderStream(capseo_info_t *info, int fd, capseo_stream_t **st
 
 	(*stream)->fd = fd;
 	(*stream)->frameHandle = cs;
-	(*stream)->encodedBuffer = new uint8_t[decodedBufferLength + 36000];
+	(*stream)->streamBase = streamBase;
+	(*stream)->headerLength = headerLength;
+
+	// frames are read into encodedBuffer, unless decoded straight from the mapped file
+	if (!info->mmap_input || !mapDecoderStream(*stream)) {
+		(*stream)->encodedBufferLength = decodedBufferLength + 36000;
+		(*stream)->encodedBuffer = new uint8_t[(*stream)->encodedBufferLength];
+	}
 
 	for (int i = 0; i < 2; ++i) {
 		bzero(&(*stream)->frames[i], sizeof(capseo_frame_t));
@@ -95,6 +176,15 @@ inline int CreateDecoderStream(capseo_info_t *info, int fd, capseo_stream_t **st
 
 	(*stream)->encodedHeader = new uint8_t[max(sizeof(TCapseoStreamHeader), sizeof(TCapseoFrameHeader))];
 
+	if (info->decode_ahead > 0) {
+		if (int error = createDecodeAhead(*stream, info->decode_ahead)) {
+			CapseoStreamDestroy(*stream);
+			*stream = 0;
+
+			return error;
+		}
+	}
+
 	return CAPSEO_SUCCESS;
 }
 
@@ -179,6 +269,17 @@ int CapseoStreamCreateFd(int mode, capseo_info_t *info, int fd, capseo_stream_t
  *  \endcode
  */
 void CapseoStreamDestroy(capseo_stream_t *stream) {
+	if (stream->async)
+		destroyAsyncEncoder(stream);
+
+	if (stream->ahead)
+		destroyDecodeAhead(stream);
+
+	if (stream->frameHandle.info.mode == CAPSEO_MODE_ENCODE)
+		writeStreamIndex(stream);
+
+	destroyStreamIndex(stream);
+
 	if (stream->autoCloseFd)
 		close(stream->fd);
 
@@ -186,6 +287,9 @@ void CapseoStreamDestroy(capseo_stream_t *stream) {
 	for (int i = 0; i < frameCount; ++i)
 		delete[] stream->frames[i].buffer;
 
+	if (stream->map)
+		munmap(stream->map, stream->mapLength);
+
 	delete[] stream->encodedBuffer; // decoder only, currently
 	delete[] stream->encodedHeader; // decoder only, currently
 
@@ -202,62 +306,218 @@ capseo_frame_id_t CapseoStreamCreateFrameID(capseo_stream_t *stream) {
 	return CapseoCreateFrameID(&stream->frameHandle);
 }
 
+/*! \brief writes an encoded frame to the stream.
+ */
+int writeStreamFrame(capseo_stream_t *stream, uint8_t *encodedFrame, int length) {
+	// write encoded frame length (glue code)
+	uint32_t frameLength = length;
+	int nwritten = write(stream->fd, &frameLength, sizeof(frameLength));
+	if (nwritten != sizeof(frameLength))
+		return CAPSEO_E_SYSTEM;
+
+	// actually write encoded frame
+	nwritten = write(stream->fd, encodedFrame, length);
+	if (nwritten != length)
+		return CAPSEO_E_SYSTEM;
+
+	appendStreamIndex(stream, encodedFrame);
+	stream->streamOffset += sizeof(frameLength) + length;
+
+	return CAPSEO_SUCCESS;
+}
+
 /*! \brief encodes given frame
  *  \param stream the stream to write the encoded frame to.
- *  \param frame the raw input frame to encode
+ *  \param frame the raw input frame to encode, bottom-up as read by glReadPixels()
  *  \param id the frame ID that belongs to this frame
  *  \retval CAPSEO_SUCCESS success
  *  \retval CAPSEO_SYSTEM system stream write error
  *  \return or any other value returned by CapseoEncodeFrame()
  *  \see CapseoStreamCreateFileName(), CapseoStreamDecodeFrame(), CapseoEncodeFrame()
+ *
+ *  \remarks If the stream has been created with a non-zero \p async_frames value,
+ *           the frame is just copied and queued for encoding and writing in background.
+ *           Errors while doing so are reported by the next call to this function.
  */
 int CapseoStreamEncodeFrame(capseo_stream_t *stream, uint8_t *frame, capseo_frame_id_t id, capseo_cursor_t *cursor) {
+	return CapseoStreamEncodeFrameEx(stream, frame, 0, CAPSEO_INPUT_BOTTOM_UP, id, cursor);
+}
+
+/*! \brief encodes given frame, read straight from (possibly padded or read-only) memory.
+ *  \param stream the stream to write the encoded frame to.
+ *  \param frame the raw input frame to encode
+ *  \param stride distance between the starts of two rows in bytes, or 0 for tightly packed rows.
+ *  \param flags CAPSEO_INPUT_BOTTOM_UP, if the frame's rows are stored bottom-up, in which case they
+ *               are flipped for top-down streams. Otherwise they are taken in the stream's row order.
+ *  \param id the frame ID that belongs to this frame
+ *  \see CapseoStreamEncodeFrame(), CapseoEncodeFrameEx()
+ */
+int CapseoStreamEncodeFrameEx(capseo_stream_t *stream, const uint8_t *frame, int stride, int flags, capseo_frame_id_t id, capseo_cursor_t *cursor) {
+	if (stream->async)
+		return submitAsyncFrame(stream, frame, stride, flags, id, cursor);
+
 	uint8_t *encodedFrame;
 	int length;
 
-	if (int error = CapseoEncodeFrame(&stream->frameHandle, frame, id, cursor, &encodedFrame, &length))
+	if (int error = CapseoEncodeFrameEx(&stream->frameHandle, frame, stride, flags, id, cursor, &encodedFrame, &length))
 		return error;
 
-	// write encoded frame length (glue code)
-	uint32_t frameLength = length;
-	int nwritten = write(stream->fd, &frameLength, sizeof(frameLength));
-	if (nwritten != sizeof(frameLength))
-		return CAPSEO_E_SYSTEM;
+	if (int error = writeStreamFrame(stream, encodedFrame, length))
+		return error;
 
-	// actually write encoded frame
-	nwritten = write(stream->fd, encodedFrame, length);
-	if (nwritten != length)
-		return CAPSEO_E_SYSTEM;
+	++stream->processedFrames;
 
 	return CAPSEO_SUCCESS;
 }
 
-/*! \brief decodes a frame from stream
- *  \param stream the stream to decode the frames from
- *  \param frame
- *  \param cursor boolean, decides whether to include the cursor if availabe or not
- *  \return pointer to decoded frame or NULL on decoding error
- *  \see CapseoStreamCreateFileName(), CapseoStreamEncodeFrame(), CapseoStreamDestroy(), CapseoDecodeFrame()
- */ 
-int CapseoStreamDecodeFrame(capseo_stream_t *stream, capseo_frame_t **frame, int cursor) {
-	// read encoded frame length (glue code)
+/*! \brief retrieves the stream encoder's frame counters.
+ *  \param stream the encoding stream
+ *  \param stats the counters will be stored here
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_INVALID_ARGUMENT not an encoding stream
+ */
+int CapseoStreamGetStats(capseo_stream_t *stream, capseo_stream_stats_t *stats) {
+	if (stream->frameHandle.info.mode != CAPSEO_MODE_ENCODE)
+		return CAPSEO_E_INVALID_ARGUMENT;
+
+	if (stream->async) {
+		getAsyncStats(stream, stats);
+	} else {
+		stats->submitted = stream->processedFrames;
+		stats->written = stream->processedFrames;
+		stats->dropped = 0;
+	}
+
+	return CAPSEO_SUCCESS;
+}
+
+/*! \brief reads the next encoded frame of the decoding stream.
+ *  \param stream the decoding stream
+ *  \param buffer the buffer to read the frame into (grown if needed), unless the stream file is mapped
+ *  \param bufferLength the length of \p buffer
+ *  \param encodedFrame the encoded frame will be stored here, either \p buffer or a pointer into the mapping
+ *  \param length the encoded frame's length will be stored here
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_STREAM_END there are no more frames
+ *  \retval CAPSEO_E_SYSTEM read error or truncated frame
+ */
+int readStreamFrame(capseo_stream_t *stream, uint8_t **buffer, uint32_t *bufferLength, uint8_t **encodedFrame, uint32_t *length) {
 	uint32_t frameLength;
+
+	if (stream->map) {
+		const size_t available = stream->mapLength - stream->mapOffset;
+		if (available == 0)
+			return CAPSEO_STREAM_END;
+
+		// encoded frame length (glue code)
+		if (available < sizeof(frameLength))
+			return CAPSEO_E_SYSTEM;
+
+		memcpy(&frameLength, stream->map + stream->mapOffset, sizeof(frameLength));
+
+		if (frameLength == CAPSEO_INDEX_SENTINEL)
+			return CAPSEO_STREAM_END;
+
+		if (frameLength > available - sizeof(frameLength))
+			return CAPSEO_E_SYSTEM;
+
+		// (the decoder never writes to its input)
+		*encodedFrame = stream->map + stream->mapOffset + sizeof(frameLength);
+		*length = frameLength;
+		stream->mapOffset += sizeof(frameLength) + frameLength;
+
+		adviseReadahead(stream);
+
+		return CAPSEO_SUCCESS;
+	}
+
+	// read encoded frame length (glue code)
 	int nread = read(stream->fd, &frameLength, sizeof(frameLength));
 	if (nread != sizeof(frameLength))
 		return nread == 0 
 			? CAPSEO_STREAM_END
 			: CAPSEO_E_SYSTEM;
 
+	if (frameLength == CAPSEO_INDEX_SENTINEL)
+		return CAPSEO_STREAM_END;
+
+	if (frameLength > *bufferLength) {
+		delete[] *buffer;
+		*buffer = new uint8_t[frameLength];
+		*bufferLength = frameLength;
+	}
+
 	// read encoded frame
-	nread = read(stream->fd, stream->encodedBuffer, frameLength);
+	nread = read(stream->fd, *buffer, frameLength);
 	if (nread != int(frameLength))
 		return CAPSEO_E_SYSTEM;
 
+	*encodedFrame = *buffer;
+	*length = frameLength;
+
+	return CAPSEO_SUCCESS;
+}
+
+/*! \brief reads and decodes the next frame of the stream right away.
+ *
+ *  Decoded frames alternate between the stream's two frame buffers.
+ *  \see CapseoStreamDecodeFrame()
+ */
+int decodeStreamFrame(capseo_stream_t *stream, capseo_frame_t **frame, int cursor) {
+	uint8_t *encodedFrame;
+	uint32_t frameLength;
+
+	if (int error = readStreamFrame(stream, &stream->encodedBuffer, &stream->encodedBufferLength, &encodedFrame, &frameLength))
+		return error;
+
 	// choose frame storage
 	*frame = &stream->frames[stream->processedFrames++ % 2];
 
 	// actually decode frame
-	return CapseoDecodeFrame(&stream->frameHandle, stream->encodedBuffer, frameLength, cursor, *frame);
+	return CapseoDecodeFrame(&stream->frameHandle, encodedFrame, frameLength, cursor, *frame);
+}
+
+/*! \brief decodes a frame from stream
+ *  \param stream the stream to decode the frames from
+ *  \param frame
+ *  \param cursor boolean, decides whether to include the cursor if availabe or not
+ *  \return pointer to decoded frame or NULL on decoding error
+ *  \see CapseoStreamCreateFileName(), CapseoStreamEncodeFrame(), CapseoStreamDestroy(), CapseoDecodeFrame()
+ *
+ *  \remarks Without \p decode_ahead, the frame is overwritten by the next but one call.
+ *           With it, the frame is taken from the decode-ahead ring and stays valid until
+ *           released by CapseoStreamReleaseFrame(). As frames are decoded ahead of their
+ *           call, a change of \p cursor only applies to the frames not decoded yet.
+ */ 
+int CapseoStreamDecodeFrame(capseo_stream_t *stream, capseo_frame_t **frame, int cursor) {
+	if (stream->ahead)
+		return takeAheadFrame(stream, frame, cursor);
+
+	return decodeStreamFrame(stream, frame, cursor);
+}
+
+/*! \brief keeps a frame of a decode-ahead stream, until released once more.
+ *  \param stream the decoding stream
+ *  \param frame a frame returned by CapseoStreamDecodeFrame() and not released yet
+ *  \retval CAPSEO_SUCCESS success
+ *  \retval CAPSEO_E_NOT_SUPPORTED the stream does not decode ahead, so frames cannot be kept
+ *  \retval CAPSEO_E_INVALID_ARGUMENT not a frame held by the caller
+ */
+int CapseoStreamRetainFrame(capseo_stream_t *stream, capseo_frame_t *frame) {
+	if (!stream->ahead)
+		return CAPSEO_E_NOT_SUPPORTED;
+
+	return retainAheadFrame(stream, frame);
+}
+
+/*! \brief releases a frame returned by CapseoStreamDecodeFrame() (or retained).
+ *
+ *  Once all references are released, the frame's buffer is reused for decoding ahead.
+ *  Does nothing for streams not decoding ahead.
+ */
+void CapseoStreamReleaseFrame(capseo_stream_t *stream, capseo_frame_t *frame) {
+	if (stream->ahead)
+		releaseAheadFrame(stream, frame);
 }
 
 // vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,159 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (Worker Thread Pool implementation)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#include "workers.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+struct TWorkerPool {
+	pthread_t *threads;
+	int threadCount;
+
+	pthread_mutex_t lock;
+	pthread_cond_t workAvailable;
+	pthread_cond_t workDone;
+
+	TWorkerJob job;
+	void **arguments;
+	int count;				//!< number of jobs in current batch
+	int next;				//!< index of next job to be picked up
+	int pending;			//!< number of jobs not yet finished
+	unsigned generation;	//!< incremented on each new batch
+	bool quit;
+};
+
+/*! \brief runs jobs of the current batch until there are no more left.
+ *  \remarks must be called with the pool lock held, and returns with it held.
+ */
+static void runJobs(TWorkerPool *pool) {
+	while (pool->next < pool->count) {
+		void *argument = pool->arguments[pool->next++];
+
+		pthread_mutex_unlock(&pool->lock);
+		pool->job(argument);
+		pthread_mutex_lock(&pool->lock);
+
+		if (--pool->pending == 0)
+			pthread_cond_broadcast(&pool->workDone);
+	}
+}
+
+static void *workerMain(void *AHandle) {
+	TWorkerPool *pool = (TWorkerPool *)AHandle;
+	unsigned generation = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->quit && generation == pool->generation)
+			pthread_cond_wait(&pool->workAvailable, &pool->lock);
+
+		if (pool->quit)
+			break;
+
+		generation = pool->generation;
+		runJobs(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/*! \brief computes the number of threads to use.
+ *  \param AHint the number of threads requested, or 0 for one per online CPU.
+ */
+int WorkerCount(int AHint) {
+	if (AHint > 0)
+		return AHint;
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? int(cpus) : 1;
+}
+
+/*! \brief creates a pool of persistent worker threads.
+ *  \param AThreads total number of threads to process jobs with, including the calling thread.
+ *  \return the pool handle
+ */
+void *WorkerPoolCreate(int AThreads) {
+	TWorkerPool *pool = new TWorkerPool;
+
+	pool->threadCount = 0;
+	pool->threads = new pthread_t[AThreads > 1 ? AThreads - 1 : 1];
+	pool->job = 0;
+	pool->arguments = 0;
+	pool->count = 0;
+	pool->next = 0;
+	pool->pending = 0;
+	pool->generation = 0;
+	pool->quit = false;
+
+	pthread_mutex_init(&pool->lock, 0);
+	pthread_cond_init(&pool->workAvailable, 0);
+	pthread_cond_init(&pool->workDone, 0);
+
+	for (int i = 1; i < AThreads; ++i)
+		if (pthread_create(&pool->threads[pool->threadCount], 0, &workerMain, pool) == 0)
+			++pool->threadCount;
+
+	return pool;
+}
+
+/*! \brief runs \p AJob once for each argument, in parallel, and waits for all of them to complete.
+ *  \param AHandle the worker pool
+ *  \param AJob the job to run
+ *  \param AArguments the list of arguments, one per job invocation
+ *  \param ACount the number of arguments in \p AArguments
+ */
+void WorkerPoolRun(void *AHandle, TWorkerJob AJob, void **AArguments, int ACount) {
+	TWorkerPool *pool = (TWorkerPool *)AHandle;
+
+	pthread_mutex_lock(&pool->lock);
+
+	pool->job = AJob;
+	pool->arguments = AArguments;
+	pool->count = ACount;
+	pool->next = 0;
+	pool->pending = ACount;
+	++pool->generation;
+
+	pthread_cond_broadcast(&pool->workAvailable);
+
+	// do not sit idle while waiting
+	runJobs(pool);
+
+	while (pool->pending > 0)
+		pthread_cond_wait(&pool->workDone, &pool->lock);
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void WorkerPoolDestroy(void *AHandle) {
+	TWorkerPool *pool = (TWorkerPool *)AHandle;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->workAvailable);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 0; i < pool->threadCount; ++i)
+		pthread_join(pool->threads[i], 0);
+
+	pthread_cond_destroy(&pool->workDone);
+	pthread_cond_destroy(&pool->workAvailable);
+	pthread_mutex_destroy(&pool->lock);
+
+	delete[] pool->threads;
+	delete pool;
+}
+
+// vim:ai:noet:ts=4:nowrap
@@ -0,0 +1,25 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+//  CAPSEO - Capseo Video Codec Library
+//  $Id$
+//  (Worker Thread Pool API)
+//
+//  Authors:
+//      Copyright (c) 2008 by Christian Parpart <trapni@gentoo.org>
+//
+//  This file as well as its whole library is licensed under
+//  the terms of GPL. See the file COPYING.
+//
+/////////////////////////////////////////////////////////////////////////////
+#ifndef capseo_workers_h
+#define capseo_workers_h
+
+typedef void (*TWorkerJob)(void *AArgument);
+
+int WorkerCount(int AHint);
+
+void *WorkerPoolCreate(int AThreads);
+void WorkerPoolRun(void *AHandle, TWorkerJob AJob, void **AArguments, int ACount);
+void WorkerPoolDestroy(void *AHandle);
+
+#endif
@@ -37,6 +37,19 @@ int die(const char *msg, ...) {//{{{
 	return 1;
 }//}}}
 
+const char *compressionName(int ACompression) {
+	switch (ACompression) {
+		case CAPSEO_COMPRESSION_QUICKLZ:
+			return "quicklz";
+		case CAPSEO_COMPRESSION_LZ4:
+			return "lz4";
+		case CAPSEO_COMPRESSION_NONE:
+			return "none";
+		default:
+			return "unknown";
+	}
+}
+
 int main(int argc, char *argv[]) {
 	if (argc != 2)
 		return die("Invalid argument count");
@@ -59,11 +72,23 @@ int main(int argc, char *argv[]) {
 	printf("  frame width      : %d\n", info.width);
 	printf("  frame height     : %d\n", info.height);
 	printf("  frame scale      : %d\n", info.scale);
+	printf("  orientation      : %s\n", info.orientation == CAPSEO_ORIENTATION_TOP_DOWN ? "top-down" : "bottom-up");
+	printf("  compression      : %s", compressionName(info.compression));
+	if (info.compression_level)
+		printf(" (level %d)", info.compression_level);
+	printf("\n");
 	printf("  fps hint         : ");
 	if (info.fps)
 		printf("%d\n", info.fps);
 	else
 		printf("n/a\n");
+
+	capseo_frame_id_t first, last;
+	uint64_t frames;
+	if (CapseoStreamGetDuration(stream, &first, &last, &frames) == CAPSEO_SUCCESS) {
+		printf("  frames           : %llu\n", (unsigned long long)frames);
+		printf("  duration         : %.2fs\n", (last - first) / 1000000.0);
+	}
 	printf("\n");
 
 	printf("cursor\n");
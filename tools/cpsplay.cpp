@@ -91,7 +91,14 @@ capseo_stream_t *stream = 0;	//!< capseo stream to be played
 capseo_info_t info;				//!< capseo out parametera (header informations)
 
 void DrawFrame(capseo_frame_t *frame) {
-	glRasterPos2i(-1, -1);
+	if (info.orientation == CAPSEO_ORIENTATION_TOP_DOWN) {
+		// draw downwards from the upper left corner
+		glRasterPos2i(-1, 1);
+		glPixelZoom(1, -1);
+	} else {
+		glRasterPos2i(-1, -1);
+		glPixelZoom(1, 1);
+	}
 	glDrawPixels(info.width, info.height, GL_BGRA, GL_UNSIGNED_BYTE, frame->buffer);
 }
 
@@ -101,6 +108,8 @@ int main(int argc, char *argv[]) {
 	return 42;
 #endif
 	bzero(&info, sizeof(capseo_info_t));
+	info.format = CAPSEO_FORMAT_BGRA;
+	info.decode_ahead = 4; // (decompression never stalls drawing)
 	const char *fileName = argc >= 2 ? argv[1] : "/tmp/example.captury";
 
 	capseo_stream_t *stream;
@@ -139,6 +148,7 @@ int main(int argc, char *argv[]) {
 
 		++frameCount;
 		DrawFrame(frame);
+		CapseoStreamReleaseFrame(stream, frame);
 		glXSwapBuffers(dpy, win);
 	}
 
@@ -26,10 +26,14 @@
 #include <string.h>
 #include <time.h>
 
+#include <limits.h>
+
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #if THEORA
 # include <ogg/ogg.h>
@@ -40,6 +44,10 @@
 # define O_LARGEFILE (0) // place a stub.
 #endif
 
+#if !defined(IOV_MAX)
+# define IOV_MAX (1024) // POSIX minimum is 16, Linux has 1024
+#endif
+
 /// \todo refactor code to be more clean (no ugly global vars)
 /// \todo add process info (completion ETA, %, ...)
 
@@ -50,15 +58,19 @@ public:
 	virtual void initialize() = 0;
 	virtual unsigned writeFrame(capseo_frame_t * frame, bool last = false) = 0;
 	virtual void finalize() = 0;
+
+	//! whether writeFrame() takes frames bottom-up, as decoded from bottom-up streams (otherwise they get flipped upright first)
+	virtual bool bottomUp() const { return false; }
 };//}}}
 
 int fps = 25;					//!< average fps to re-encode with
 int inputFd = -1;				//!< file descriptor, where to read the capseo video from
+const char *inputFileName = 0;	//!< input file name, if not reading from stdin
+int segments = 1;				//!< number of segments to transcode in parallel
 int outputFd = -1;				//!< file descriptor, where to write the re-encoded video to
 capseo_stream_t *stream = 0;	//!< capseo input stream handle
 capseo_info_t info;				//!< capseo out parameters
 IEncoder *encoder = 0;			//!< the encoder to use
-bool FDupFrame = false;			//!< true when frame is being reused
 int verbose = 1;				//!< verbosity level (0 = quiet)
 
 int die(const char *fmt, ...) {//{{{
@@ -84,6 +96,7 @@ void printHelp() {//{{{
 		"\t-c:  specify output codec to use (y4m only)\n"
 #endif
 		"\t-o:  output filename (or - for stdout)\n"
+		"\t-j:  number of segments to transcode in parallel (y4m to a file only)\n"
 		"\t-q:  be quiet when processing\n"
 		"\t-h:  print help text\n",
 		VERSION
@@ -95,39 +108,102 @@ inline T diff(const T& t1, const T& t2) {
 	return t1 < t2 ? t2 - t1 : t1 - t2;
 }
 
+/*! \brief writes the given I/O vector (advancing it) at \p AOffset, or at the current offset if negative.
+ *  \return number of bytes written
+ *
+ *  Issues as few writev()/pwritev() calls as IOV_MAX and partial writes permit.
+ */
+size_t writeVector(int fd, struct iovec *iov, int count, off64_t AOffset = -1) {
+	size_t nwritten = 0;
+
+	while (count > 0) {
+		ssize_t rv = AOffset < 0
+			? writev(fd, iov, count < IOV_MAX ? count : IOV_MAX)
+			: pwritev64(fd, iov, count < IOV_MAX ? count : IOV_MAX, AOffset + nwritten);
+
+		if (rv < 0 && errno == EINTR)
+			continue;
+
+		if (rv <= 0)
+			die("Error writing output: %s", strerror(errno));
+
+		nwritten += rv;
+
+		// skip what has been written
+		for (; count > 0 && size_t(rv) >= iov->iov_len; --count, ++iov)
+			rv -= iov->iov_len;
+
+		if (count > 0) {
+			iov->iov_base = (char *)iov->iov_base + rv;
+			iov->iov_len -= rv;
+		}
+	}
+
+	return nwritten;
+}
+
+/*! \brief fills the I/O vector with a y4m frame of the given decoded YUV 4:2:0 frame.
+ *  \return number of entries used (at most 2 * info.height + 1)
+ *
+ *  Bottom-up frames are gathered row by row in reverse order, so they get written upright
+ *  without copying. Top-down frames are gathered plane by plane.
+ */
+int gatherFrame(struct iovec *iov, uint8_t *buffer) {
+	static const char header[] = "FRAME\n";
+
+	const int width[3] = { info.width, info.width / 2, info.width / 2 };
+	const int height[3] = { info.height, info.height / 2, info.height / 2 };
+
+	int count = 0;
+	iov[count].iov_base = (void *)header;
+	iov[count++].iov_len = sizeof(header) - 1;
+
+	for (int plane = 0; plane < 3; ++plane) {
+		if (info.orientation == CAPSEO_ORIENTATION_TOP_DOWN) {
+			iov[count].iov_base = buffer;
+			iov[count++].iov_len = width[plane] * height[plane];
+		} else {
+			for (int y = height[plane] - 1; y >= 0; --y) {
+				iov[count].iov_base = buffer + y * width[plane];
+				iov[count++].iov_len = width[plane];
+			}
+		}
+
+		buffer += width[plane] * height[plane];
+	}
+
+	return count;
+}
+
 class TY4MEncoder : public IEncoder {//{{{
+private:
+	struct iovec *FVector;
+
 public:
+	TY4MEncoder() : FVector(0) {}
+
+	virtual ~TY4MEncoder() {
+		delete[] FVector;
+	}
+
 	virtual void initialize() {
 		char header[128];
 		int n = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip\n", info.width, info.height, fps);
 		write(outputFd, header, n);
+
+		FVector = new struct iovec[2 * info.height + 1];
 	}
 
 	virtual unsigned writeFrame(capseo_frame_t *frame, bool /*last*/) {
-		unsigned nwritten = 0;
-		static const char header[] = "FRAME\n";
-		nwritten += write(outputFd, header, sizeof(header) - 1);
-
-		uint8_t *buffer = frame->buffer;
-
-		// write each freame row up-side-down
-		for (int y = info.height - 1; y >= 0; --y)
-			nwritten += write(outputFd, buffer + y * info.width, info.width);
-
-		buffer += info.width * info.height;
-
-		for (int i = 0; i < 2; ++i) {
-			for (int y = (info.height / 2) - 1; y >= 0; --y)
-				nwritten += write(outputFd, buffer + y * (info.width / 2), (info.width / 2));
-
-			buffer += info.width * info.height / 4;
-		}
-
-		return nwritten;
+		return writeVector(outputFd, FVector, gatherFrame(FVector, frame->buffer));
 	}
 
 	virtual void finalize() {
 	}
+
+	virtual bool bottomUp() const {
+		return true;
+	}
 };//}}}
 
 #if THEORA
@@ -137,8 +213,6 @@ private:
 	ogg_packet FVideoPacket;
 	theora_state FVideoCodec;
 	yuv_buffer yuv;
-	unsigned char *buffer;
-	unsigned char *tmp;			//!< for v-flipping
 
 //	ogg_stream_state FAudioStream;
 //	ogg_packet FAudioPacket;
@@ -146,9 +220,6 @@ private:
 
 public:
 	virtual void initialize() {
-		tmp = new unsigned char[info.width];
-		buffer = new unsigned char[info.width * info.height * 4];
-
 		yuv.y_width = ((info.width + 15) >> 4) << 4;
 		yuv.y_height = ((info.height + 15) >> 4) << 4;
 		yuv.y_stride = yuv.y_width;
@@ -164,44 +235,8 @@ public:
 		theoraTables();
 	}
 
-	#define YUV_Y(line) (y + ((line) * info.width))
-	#define YUV_U(line) (u + ((line) * info.width / 2))
-	#define YUV_V(line) (v + ((line) * info.width / 2))
-
-	unsigned char *flipV(capseo_frame_t *frame) {
-		if (FDupFrame)
-			return frame->buffer;
-
-		unsigned char *y = frame->buffer;
-		unsigned char *u = y + info.width * info.height;
-		unsigned char *v = u + info.width * info.height / 4;
-
-		const int w2 = info.width / 2;
-
-		for (int y0 = 0, y1 = info.height - 1; y0 < info.height / 2; ++y0, --y1) {
-			// vflip y
-			memcpy(tmp, YUV_Y(y0), info.width);
-			memcpy(YUV_Y(y0), YUV_Y(y1), info.width);
-			memcpy(YUV_Y(y1), tmp, info.width);
-		}
-
-		for (int y0 = 0, y1 = (info.height/2 - 1); y0 < info.height / 4; ++y0, --y1) {
-			// vflip u
-			memcpy(tmp, YUV_U(y0), w2);
-			memcpy(YUV_U(y0), YUV_U(y1), w2);
-			memcpy(YUV_U(y1), tmp, w2);
-
-			// vflip v
-			memcpy(tmp, YUV_V(y0), w2);
-			memcpy(YUV_V(y0), YUV_V(y1), w2);
-			memcpy(YUV_V(y1), tmp, w2);
-		}
-
-		return frame->buffer;
-	}
-
 	virtual unsigned writeFrame(capseo_frame_t *frame, bool last) {
-		yuv.y = flipV(frame);
+		yuv.y = frame->buffer;
 		yuv.u = yuv.y + info.width * info.height;
 		yuv.v = yuv.u + info.width * info.height / 4;
 
@@ -224,9 +259,6 @@ public:
 		theora_clear(&FVideoCodec);
 		ogg_stream_clear(&FVideoStream);
 //		ogg_stream_destroy(&FVideoStream);
-
-		delete[] buffer;
-		delete[] tmp;
 	}
 
 private:
@@ -461,6 +493,96 @@ inline TValue TPerformanceCounter<TValue, PERIOD>::average() const {
 }
 // }}}
 
+//{{{ TQueue<T>
+/*! \brief bounded FIFO connecting two pipeline stages.
+ *
+ *  push() blocks while the queue is full, pop() while it is empty.
+ *  Once closed, pop() drains the remaining items and then fails.
+ */
+template<typename T>
+class TQueue {
+private:
+	T *FItems;
+	unsigned FCapacity;
+	unsigned FHead;
+	unsigned FCount;
+	bool FClosed;
+
+	pthread_mutex_t FLock;
+	pthread_cond_t FNotEmpty;
+	pthread_cond_t FNotFull;
+
+public:
+	explicit TQueue(unsigned ACapacity);
+	~TQueue();
+
+	void push(const T& AItem);
+	bool pop(T& AItem);
+	void close();
+};
+
+template<typename T>
+inline TQueue<T>::TQueue(unsigned ACapacity) :
+	FItems(new T[ACapacity]), FCapacity(ACapacity), FHead(0), FCount(0), FClosed(false) {
+	pthread_mutex_init(&FLock, 0);
+	pthread_cond_init(&FNotEmpty, 0);
+	pthread_cond_init(&FNotFull, 0);
+}
+
+template<typename T>
+inline TQueue<T>::~TQueue() {
+	pthread_cond_destroy(&FNotFull);
+	pthread_cond_destroy(&FNotEmpty);
+	pthread_mutex_destroy(&FLock);
+
+	delete[] FItems;
+}
+
+template<typename T>
+inline void TQueue<T>::push(const T& AItem) {
+	pthread_mutex_lock(&FLock);
+
+	while (FCount == FCapacity)
+		pthread_cond_wait(&FNotFull, &FLock);
+
+	FItems[(FHead + FCount++) % FCapacity] = AItem;
+
+	pthread_cond_signal(&FNotEmpty);
+	pthread_mutex_unlock(&FLock);
+}
+
+template<typename T>
+inline bool TQueue<T>::pop(T& AItem) {
+	pthread_mutex_lock(&FLock);
+
+	while (FCount == 0 && !FClosed)
+		pthread_cond_wait(&FNotEmpty, &FLock);
+
+	const bool available = FCount > 0;
+	if (available) {
+		AItem = FItems[FHead];
+		FHead = (FHead + 1) % FCapacity;
+		--FCount;
+
+		pthread_cond_signal(&FNotFull);
+	}
+
+	pthread_mutex_unlock(&FLock);
+
+	return available;
+}
+
+template<typename T>
+inline void TQueue<T>::close() {
+	pthread_mutex_lock(&FLock);
+
+	FClosed = true;
+
+	pthread_cond_broadcast(&FNotEmpty);
+	pthread_mutex_unlock(&FLock);
+}
+// }}}
+
 // {{{ progress statistics
 // fps and write bps counter for an average period of 10 seconds
 TPerformanceCounter<double, 10> FFpsCounter;
@@ -506,11 +628,26 @@ void printProcess() {
 		getProgress()
 	);
 }
+
+pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*! \brief accounts for a frame of \p ANumBytes written and prints the progress.
+ */
+void countFrame(unsigned ANumBytes) {
+	pthread_mutex_lock(&statsLock);
+
+	FBpsCounter.touch(ANumBytes);
+	FFpsCounter.touch();
+
+	printProcess();
+
+	pthread_mutex_unlock(&statsLock);
+}
 // }}}
 
 void parseCmdLineArgs(int argc, char *argv[]) {//{{{
 	int nargs = 1;
-	for (int c; (c = getopt(argc, argv, "r:i:c:o:hq")) != -1; ++nargs) {
+	for (int c; (c = getopt(argc, argv, "r:i:c:o:j:hq")) != -1; ++nargs) {
 		switch (c) {
 			case 'q':
 				verbose = 0;
@@ -523,6 +660,8 @@ void parseCmdLineArgs(int argc, char *argv[]) {//{{{
 					inputFd = STDIN_FILENO;
 				else if ((inputFd = open(optarg, O_RDONLY | O_LARGEFILE)) == -1)
 					die("Error opening input file(%s): %s", optarg, strerror(errno));
+				else
+					inputFileName = optarg;
 
 				break;
 			case 'o':
@@ -531,6 +670,11 @@ void parseCmdLineArgs(int argc, char *argv[]) {//{{{
 				else if ((outputFd = open(optarg, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE, 0644)) == -1)
 					die("Error opening output file(%s): %s", optarg, strerror(errno));
 
+				break;
+			case 'j':
+				if ((segments = atoi(optarg)) < 1)
+					die("Invalid segment count: %s\n", optarg);
+
 				break;
 			case 'c':
 #if THEORA
@@ -561,57 +705,313 @@ void parseCmdLineArgs(int argc, char *argv[]) {//{{{
 	if (outputFd == -1)
 		die("No output file specified");
 
+	if (segments > 1 && !inputFileName)
+		die("Segmented transcoding needs an input file");
+
+	if (segments > 1 && !dynamic_cast<TY4MEncoder *>(encoder))
+		die("Segmented transcoding supports y4m output only");
+
+	if (segments > 1 && lseek64(outputFd, 0, SEEK_CUR) == -1)
+		die("Segmented transcoding needs an output file");
+
 	info.format = CAPSEO_FORMAT_YUV420;
+	info.mmap_input = 1; // (falls back to read() for pipes)
 	if (int error = CapseoStreamCreateFd(CAPSEO_MODE_DECODE, &info, inputFd, &stream))
 		die("Could not create input stream (error %d)", error);
 }//}}}
 
-int main(int argc, char *argv[]) {
-	bzero(&info, sizeof(capseo_info_t));
+// {{{ transcoding pipeline
+//
+// decode stage: reads and decodes the input stream, and resamples it to the output frame rate
+// flip stage:   flips the decoded frames upright (unless stored top-down, or the encoder takes them bottom-up)
+// main thread:  encodes and writes the output stream
+//
+// Frame buffers circulate from a fixed pool, so a stalled stage eventually stalls its producers.
 
-	parseCmdLineArgs(argc, argv);
+/*! a decoded frame travelling through the pipeline */
+struct TFrame {
+	capseo_frame_t frame;
+	unsigned repeat;			//!< number of output frames it stands for (0 if dropped by resampling)
+	bool last;					//!< true for the input stream's last frame
+};
 
-	encoder->initialize();
+const unsigned QUEUE_DEPTH = 4;							//!< frames buffered between two stages
+const unsigned POOL_SIZE = 2 * QUEUE_DEPTH + 4;			//!< queued plus in-flight frames
 
-	capseo_frame_t *frames[2];
+TQueue<TFrame *> freeFrames(POOL_SIZE);			//!< frame buffers available to the decode stage
+TQueue<TFrame *> decodedFrames(QUEUE_DEPTH);	//!< decode stage -> flip stage
+TQueue<TFrame *> flippedFrames(QUEUE_DEPTH);	//!< flip stage -> output
 
-	CapseoStreamDecodeFrame(stream, &frames[0], true);
-	CapseoStreamDecodeFrame(stream, &frames[1], true);
+void *decodeStage(void *) {
+	const unsigned frameSize = info.width * info.height * 3 / 2;
+	const uint64_t timeStep = 1000000 / fps;
+	uint64_t timeNext = 0;
 
-	uint64_t timeStep = 1000000 / fps;
-	uint64_t timeNext = frames[0]->id;
+	TFrame *current = 0;
 
 	for (;;) {
-		while (diff(frames[0]->id, timeNext) > diff(frames[1]->id, timeNext)) {
-			frames[0] = frames[1];
-			FDupFrame = false;
+		capseo_frame_t *decoded;
+		if (int error = CapseoStreamDecodeFrame(stream, &decoded, true)) {
+			if (error == CAPSEO_STREAM_END)
+				break;
 
-			if (int error = CapseoStreamDecodeFrame(stream, &frames[1], true)) {
-				if (error == CAPSEO_STREAM_END)
-					goto out;
+			die("CapseoStreamDecodeFrame: decode error (code %d)", error);
+		}
 
-				return die("CapseoStreamDecodeFrame: decode error (code %d)", error);
-			}
+		TFrame *next;
+		if (!freeFrames.pop(next))
+			break;
+
+		next->frame.id = decoded->id;
+		memcpy(next->frame.buffer, decoded->buffer, frameSize);
+		next->repeat = 0;
+		next->last = false;
 
-			if (!frames[1])
-				goto out;
+		if (!current) {
+			current = next;
+			timeNext = current->frame.id;
+			continue;
 		}
 
-		FFpsCounter.touch();
-		unsigned nwritten = encoder->writeFrame(frames[0]);
-		FBpsCounter.touch(nwritten);
+		// the current frame is output for every tick it is nearer to than the next frame
+		while (timeNext <= next->frame.id && diff<uint64_t>(current->frame.id, timeNext) <= diff<uint64_t>(next->frame.id, timeNext)) {
+			++current->repeat;
+			timeNext += timeStep;
+		}
 
-		FDupFrame = true;
-		timeNext += timeStep;
+		if (current->repeat)
+			decodedFrames.push(current);
+		else
+			freeFrames.push(current);
 
-		printProcess();
+		current = next;
 	}
 
-out:
-	// write last frame
-	unsigned nwritten = encoder->writeFrame(frames[0], true);
-	FBpsCounter.touch(nwritten);
-	FFpsCounter.touch();
+	if (current) {
+		current->repeat = 1;
+		current->last = true;
+		decodedFrames.push(current);
+	}
+
+	decodedFrames.close();
+
+	return 0;
+}
+
+/*! \brief flips the given YUV 4:2:0 frame vertically, in place.
+ *  \param tmp scratch space of (at least) one luma row
+ */
+void flipV(uint8_t *buffer, uint8_t *tmp) {
+	const int width[3] = { info.width, info.width / 2, info.width / 2 };
+	const int height[3] = { info.height, info.height / 2, info.height / 2 };
+
+	for (int plane = 0; plane < 3; ++plane) {
+		const int w = width[plane];
+
+		for (int y0 = 0, y1 = height[plane] - 1; y0 < y1; ++y0, --y1) {
+			memcpy(tmp, buffer + y0 * w, w);
+			memcpy(buffer + y0 * w, buffer + y1 * w, w);
+			memcpy(buffer + y1 * w, tmp, w);
+		}
+
+		buffer += w * height[plane];
+	}
+}
+
+void *flipStage(void *) {
+	uint8_t *tmp = new uint8_t[info.width];
+
+	for (TFrame *frame; decodedFrames.pop(frame); ) {
+		flipV(frame->frame.buffer, tmp);
+		flippedFrames.push(frame);
+	}
+
+	flippedFrames.close();
+
+	delete[] tmp;
+
+	return 0;
+}
+// }}}
+
+/*! \brief transcodes the input stream by the decode/flip/encode pipeline.
+ */
+void transcode() {
+	TFrame pool[POOL_SIZE];
+	for (unsigned i = 0; i < POOL_SIZE; ++i) {
+		pool[i].frame.buffer = new uint8_t[info.width * info.height * 3 / 2];
+		freeFrames.push(&pool[i]);
+	}
+
+	// top-down streams, and encoders taking bottom-up frames, do without the flip stage
+	const bool flip = info.orientation == CAPSEO_ORIENTATION_BOTTOM_UP && !encoder->bottomUp();
+	TQueue<TFrame *>& output = flip ? flippedFrames : decodedFrames;
+
+	pthread_t decoder, flipper;
+	if (pthread_create(&decoder, 0, &decodeStage, 0) || (flip && pthread_create(&flipper, 0, &flipStage, 0)))
+		die("Could not create pipeline threads");
+
+	for (TFrame *frame; output.pop(frame); ) {
+		for (unsigned i = 0; i < frame->repeat; ++i)
+			countFrame(encoder->writeFrame(&frame->frame, frame->last && i + 1 == frame->repeat));
+
+		freeFrames.push(frame);
+	}
+
+	if (flip)
+		pthread_join(flipper, 0);
+
+	pthread_join(decoder, 0);
+
+	for (unsigned i = 0; i < POOL_SIZE; ++i)
+		delete[] pool[i].frame.buffer;
+}
+
+// {{{ segment-parallel transcoding
+//
+// The output frames are split into equally long segments, each one transcoded by its own
+// thread from its own input stream, seeked to the segment's start. As y4m frames are of
+// constant size, each output frame is written straight to its final place in the output file
+// (gathered by gatherFrame(), like TY4MEncoder does).
+//
+// Every segment resamples exactly like the pipeline does, so the output is identical.
+
+struct TSegment {
+	pthread_t thread;
+	uint64_t firstTick;			//!< first output frame of this segment
+	uint64_t endTick;			//!< output frame following this segment
+	bool streamEnded;			//!< whether the input stream ended within this segment
+	uint64_t streamEndTick;		//!< output frame the input stream ended at
+	uint8_t *lastFrame;			//!< the input stream's last frame, if the stream ended
+};
+
+capseo_frame_id_t firstID = 0;	//!< ID of the input stream's first frame
+off64_t headerLength = 0;		//!< length of the y4m stream header
+size_t frameLength = 0;			//!< length of a y4m frame, including its header
+
+void writeFrameAt(struct iovec *iov, uint64_t ATick, uint8_t *buffer) {
+	const off64_t offset = headerLength + off64_t(ATick) * frameLength;
+
+	countFrame(writeVector(outputFd, iov, gatherFrame(iov, buffer), offset));
+}
+
+void *transcodeSegment(void *AArgument) {
+	TSegment *segment = (TSegment *)AArgument;
+
+	capseo_info_t si;
+	bzero(&si, sizeof(si));
+	si.format = CAPSEO_FORMAT_YUV420;
+	si.mmap_input = 1;
+
+	capseo_stream_t *input;
+	if (int error = CapseoStreamCreateFileName(CAPSEO_MODE_DECODE, &si, inputFileName, &input))
+		die("Could not create input stream (error %d)", error);
+
+	const unsigned frameSize = info.width * info.height * 3 / 2;
+	const uint64_t timeStep = 1000000 / fps;
+	uint64_t tick = segment->firstTick;
+	uint64_t timeNext = firstID + tick * timeStep;
+
+	if (int error = CapseoStreamSeek(input, timeNext))
+		die("CapseoStreamSeek: seek error (code %d)", error);
+
+	struct iovec *iov = new struct iovec[2 * info.height + 1];
+
+	// (the stream keeps its last two decoded frames, so current stays valid while decoding next)
+	capseo_frame_t *current, *next;
+	if (int error = CapseoStreamDecodeFrame(input, &current, true))
+		die("CapseoStreamDecodeFrame: decode error (code %d)", error);
+
+	while (tick < segment->endTick) {
+		if (int error = CapseoStreamDecodeFrame(input, &next, true)) {
+			if (error != CAPSEO_STREAM_END)
+				die("CapseoStreamDecodeFrame: decode error (code %d)", error);
+
+			segment->streamEnded = true;
+			segment->streamEndTick = tick;
+			segment->lastFrame = new uint8_t[frameSize];
+			memcpy(segment->lastFrame, current->buffer, frameSize);
+			break;
+		}
+
+		// the current frame is output for every tick it is nearer to than the next frame
+		while (tick < segment->endTick && timeNext <= next->id
+				&& diff<uint64_t>(current->id, timeNext) <= diff<uint64_t>(next->id, timeNext)) {
+			writeFrameAt(iov, tick++, current->buffer);
+			timeNext += timeStep;
+		}
+
+		current = next;
+	}
+
+	delete[] iov;
+
+	CapseoStreamDestroy(input);
+
+	return 0;
+}
+
+/*! \brief transcodes the input stream in parallel segments.
+ */
+void transcodeSegments() {
+	capseo_frame_id_t lastID;
+	uint64_t frames;
+	if (int error = CapseoStreamGetDuration(stream, &firstID, &lastID, &frames))
+		die("Could not scan input stream (error %d)", error);
+
+	if (!frames)
+		die("Input stream contains no frames");
+
+	headerLength = lseek64(outputFd, 0, SEEK_CUR);
+
+	frameLength = strlen("FRAME\n") + info.width * info.height * 3 / 2;
+
+	// (the last segment takes over everything up to the stream's end)
+	const uint64_t ticks = (lastID - firstID) / (1000000 / fps) + 1;
+
+	TSegment *segment = new TSegment[segments];
+	for (int i = 0; i < segments; ++i) {
+		bzero(&segment[i], sizeof(segment[i]));
+		segment[i].firstTick = ticks * i / segments;
+		segment[i].endTick = i + 1 < segments ? ticks * (i + 1) / segments : uint64_t(-1);
+
+		if (pthread_create(&segment[i].thread, 0, &transcodeSegment, &segment[i]))
+			die("Could not create segment threads");
+	}
+
+	for (int i = 0; i < segments; ++i)
+		pthread_join(segment[i].thread, 0);
+
+	// the input's last frame is output once more, right after the first segment that ran out of input
+	TSegment *end = 0;
+	for (int i = 0; i < segments; ++i)
+		if (segment[i].streamEnded && (!end || segment[i].streamEndTick < end->streamEndTick))
+			end = &segment[i];
+
+	if (end) {
+		struct iovec *iov = new struct iovec[2 * info.height + 1];
+		writeFrameAt(iov, end->streamEndTick, end->lastFrame);
+		delete[] iov;
+	}
+
+	for (int i = 0; i < segments; ++i)
+		delete[] segment[i].lastFrame;
+
+	delete[] segment;
+}
+// }}}
+
+int main(int argc, char *argv[]) {
+	bzero(&info, sizeof(capseo_info_t));
+
+	parseCmdLineArgs(argc, argv);
+
+	encoder->initialize();
+
+	if (segments > 1)
+		transcodeSegments();
+	else
+		transcode();
 
 	encoder->finalize();
 	delete encoder;